@@ -0,0 +1,43 @@
+/*
+#  File        : AllocationCounter.cpp
+#  Description : Count of the heap allocations of the program
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#include "AllocationCounter.h"
+
+#ifdef COUNT_ALLOCATIONS
+#include<atomic>
+#include<cstdlib>
+#include<new>
+
+/* Every heap allocation of the program goes through these replaced
+*  operators. CImg and the standard containers all allocate with new.
+*  Only compiled for benchmarks: the demo keeps the standard ones. */
+static std::atomic<long long> allocation_count(0);
+
+void* operator new(size_t size) {
+	++allocation_count;
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+void* operator new[](size_t size) {
+	++allocation_count;
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+
+long long allocationCount() {
+	return allocation_count;
+}
+#else
+long long allocationCount() {
+	return -1;
+}
+#endif
@@ -0,0 +1,18 @@
+/*
+#  File        : AllocationCounter.h
+#  Description : Count of the heap allocations of the program
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#pragma once
+#ifndef _AllocationCounter_
+#define _AllocationCounter_
+
+/* Heap allocations (operator new) made so far by all threads, or -1
+*  if the program is not compiled with COUNT_ALLOCATIONS defined, see
+*  AllocationCounter.cpp. Used by Benchmark::allocations. */
+long long allocationCount();
+
+#endif
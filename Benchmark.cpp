@@ -0,0 +1,876 @@
+/*
+#  File        : Benchmark.cpp
+#  Description : Micro-benchmarks of the detection and warping stages
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#include "Benchmark.h"
+#include "AllocationCounter.h"
+#include "DocumentDetector.h"
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<thread>
+#ifdef __linux__
+#include<cstring>
+#include<linux/perf_event.h>
+#include<sys/ioctl.h>
+#include<sys/syscall.h>
+#include<unistd.h>
+#endif
+
+/* Seconds elapsed since start */
+static double elapsed(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+/* Hardware cache miss counter of the calling thread (Linux perf
+*  events). Reads -1 if counters are not available, e.g. in a VM. */
+class CacheMissCounter {
+private:
+	int fd;
+public:
+	CacheMissCounter(bool l1d) : fd(-1) {
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		if (l1d) {
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D |
+				(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		}
+		else {
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CACHE_MISSES; // last level cache
+		}
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+	~CacheMissCounter() {
+#ifdef __linux__
+		if (fd >= 0) close(fd);
+#endif
+	}
+	void start() {
+#ifdef __linux__
+		if (fd < 0) return;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+	long long stop() {
+#ifdef __linux__
+		long long count;
+		if (fd < 0) return -1;
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+		return count;
+#else
+		return -1;
+#endif
+	}
+};
+
+/* Run the stages before hough voting, without any display */
+void Benchmark::prepare(Hough& hough, const char* filePath,
+	HoughOptions options) {
+	hough.options = options;
+	hough.init(filePath);
+	hough.rgb2gray();
+	hough.blur();
+	hough.getGradient();
+}
+
+/* Voting loop before trigonometric tables were introduced,
+*  kept here as the reference of the benchmark. */
+static void libmVoting(const CImg<float>& gradients, float threshold,
+	CImg<float>& hough_space) {
+	cimg_forXY(gradients, x, y) {
+		if (gradients(x, y) > threshold) {
+			cimg_forX(hough_space, angle) {
+				double theta = 1.0 * angle * cimg::PI / 180.0;
+				int rho = (int)(x*cos(theta) + y*sin(theta));
+				if (rho >= 0 && rho < hough_space.height())
+					++hough_space((angle + 180) % 360, rho);
+			}
+		}
+	}
+}
+
+/* Votes per second of 360 degree hough voting with libm calls and
+*  with tables, and the speedup of 180 degree (HALF_RANGE) voting
+*  over all angles and within the gradient window (GRADIENT_ANGLES).
+*  Like the libm loop, every run votes on one thread with the scalar
+*  kernel into an ANGLE_CONTIGUOUS accumulator, so the speedups come
+*  from the tables and the angle ranges only. */
+void Benchmark::houghVoting(const char* data_folder, int image_num) {
+	printf("%-20s %10s %14s %14s %8s %8s %8s\n", "image", "votes",
+		"libm votes/s", "table votes/s", "speedup", "half", "gradient");
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		HoughOptions options;
+		options.threads = 1;
+		options.simd = false;
+		options.layout = ANGLE_CONTIGUOUS;
+		options.accumulator = FULL_RANGE;
+		Hough hough, half, gradient;
+		prepare(hough, inPath, options);
+		options.accumulator = HALF_RANGE;
+		prepare(half, inPath, options);
+		options.voting = GRADIENT_ANGLES;
+		prepare(gradient, inPath, options);
+
+		double votes = 1.0 * hough.edges.size() * hough.angle_num;
+		CImg<float> legacy_space(360, hough.rho_num, 1, 1, 0);
+
+		double libm_time = 1e30, table_time = 1e30, half_time = 1e30,
+			gradient_time = 1e30;
+		for (int r = 0; r < REPEAT; ++r) {
+			legacy_space.fill(0);
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			libmVoting(hough.gradients, hough.GRAD_THRESHOLD, legacy_space);
+			libm_time = std::min(libm_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			hough.houghTransform();
+			table_time = std::min(table_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			half.houghTransform();
+			half_time = std::min(half_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			gradient.houghTransform();
+			gradient_time = std::min(gradient_time, elapsed(start));
+		}
+		printf("%-20s %10.0f %14.3e %14.3e %7.2fx %7.2fx %7.2fx\n", inPath,
+			votes, votes / libm_time, votes / table_time,
+			libm_time / table_time, libm_time / half_time,
+			libm_time / gradient_time);
+	}
+}
+
+/* Scaling of hough voting from 1 thread to all hardware threads */
+void Benchmark::houghThreads(const char* data_folder, int image_num) {
+	int max_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<int> thread_nums;
+	for (int t = 1; t < max_threads; t *= 2) thread_nums.push_back(t);
+	thread_nums.push_back(max_threads);
+
+	printf("%-20s %8s %10s %8s\n", "image", "threads", "time(ms)", "speedup");
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		Hough hough;
+		prepare(hough, inPath);
+		double serial_time = 0;
+		for (size_t t = 0; t < thread_nums.size(); ++t) {
+			hough.options.threads = thread_nums[t];
+			double time = 1e30;
+			for (int r = 0; r < REPEAT; ++r) {
+				std::chrono::steady_clock::time_point start =
+					std::chrono::steady_clock::now();
+				hough.houghTransform();
+				time = std::min(time, elapsed(start));
+			}
+			if (t == 0) serial_time = time;
+			printf("%-20s %8d %10.3f %7.2fx\n", inPath, thread_nums[t],
+				time * 1000, serial_time / time);
+		}
+	}
+}
+
+/* Single thread voting time and cache misses of every accumulator
+*  layout. Cache misses show as -1 if perf events are not available. */
+void Benchmark::houghLayout(const char* data_folder, int image_num) {
+	const char* layout_names[] = { "ANGLE_CONTIGUOUS", "RHO_CONTIGUOUS" };
+	AccumulatorLayout layouts[] = { ANGLE_CONTIGUOUS, RHO_CONTIGUOUS };
+	CacheMissCounter l1d_counter(true), llc_counter(false);
+	printf("%-20s %-17s %10s %14s %14s\n", "image", "layout", "time(ms)",
+		"L1D misses", "LLC misses");
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		for (int l = 0; l < 2; ++l) {
+			HoughOptions options;
+			options.layout = layouts[l];
+			options.threads = 1;
+			Hough hough;
+			prepare(hough, inPath, options);
+			double time = 1e30;
+			long long l1d_misses = -1, llc_misses = -1;
+			for (int r = 0; r < REPEAT; ++r) {
+				l1d_counter.start();
+				llc_counter.start();
+				std::chrono::steady_clock::time_point start =
+					std::chrono::steady_clock::now();
+				hough.houghTransform();
+				double t = elapsed(start);
+				long long l1d = l1d_counter.stop(), llc = llc_counter.stop();
+				if (t < time) {
+					time = t;
+					l1d_misses = l1d;
+					llc_misses = llc;
+				}
+			}
+			printf("%-20s %-17s %10.3f %14lld %14lld\n", inPath,
+				layout_names[l], time * 1000, l1d_misses, llc_misses);
+		}
+	}
+}
+
+/* Single thread voting time of the scalar and SIMD rho kernels, and
+*  whether both give exactly the same accumulator */
+bool Benchmark::houghSimd(const char* data_folder, int image_num) {
+	bool passed = true;
+	const char* level_names[] = { "scalar", "AVX2", "NEON" };
+	printf("SIMD level: %s\n", level_names[simdLevel()]);
+	printf("%-20s %12s %12s %8s %10s\n", "image", "scalar(ms)", "simd(ms)",
+		"speedup", "identical");
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		HoughOptions options;
+		options.threads = 1;
+		options.simd = false;
+		Hough scalar, simd;
+		prepare(scalar, inPath, options);
+		options.simd = true;
+		prepare(simd, inPath, options);
+		double scalar_time = 1e30, simd_time = 1e30;
+		for (int r = 0; r < REPEAT; ++r) {
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			scalar.houghTransform();
+			scalar_time = std::min(scalar_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			simd.houghTransform();
+			simd_time = std::min(simd_time, elapsed(start));
+		}
+		bool identical = scalar.hough_space16 == simd.hough_space16 &&
+			scalar.hough_space32 == simd.hough_space32;
+		passed = passed && identical;
+		printf("%-20s %12.3f %12.3f %7.2fx %10s\n", inPath,
+			scalar_time * 1000, simd_time * 1000, scalar_time / simd_time,
+			identical ? "yes" : "NO");
+	}
+	return passed;
+}
+
+/* Heap allocations of detection (DocumentDetector) and cropping
+*  (Warping) per image. The first pass over the dataset grows the
+*  buffers of the workspaces to the largest image, the second pass
+*  (steady state) should not allocate anything. Needs a build with
+*  COUNT_ALLOCATIONS defined, see AllocationCounter.cpp. */
+bool Benchmark::allocations(const char* data_folder, int image_num) {
+	if (allocationCount() < 0) {
+		printf("allocations not counted, compile with -DCOUNT_ALLOCATIONS\n");
+		return true;
+	}
+	std::vector<CImg<float> > images(image_num);
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		images[i].load_bmp(inPath);
+	}
+	DocumentDetector detector;
+	DetectionResult result;
+	Workspace warp_workspace;
+	std::vector<long long> first(image_num), steady(image_num);
+	for (int pass = 0; pass < 2; ++pass) {
+		for (int i = 0; i < image_num; ++i) {
+			long long count = allocationCount();
+			detector.detect(images[i], result);
+			if (result.ok())
+				Warping warping(images[i], result.corners, WarpOptions(),
+					&warp_workspace);
+			(pass == 0 ? first : steady)[i] = allocationCount() - count;
+		}
+	}
+	bool passed = true;
+	printf("%-20s %14s %14s\n", "image", "first pass", "steady state");
+	for (int i = 0; i < image_num; ++i) {
+		passed = passed && steady[i] == 0;
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		printf("%-20s %14lld %14lld\n", inPath, first[i], steady[i]);
+	}
+	return passed;
+}
+
+/* Bilinear sampling throughput (output megapixels per second) of the
+*  scalar and SIMD warp kernels for an A4 crop at 300 dpi, and whether
+*  both give exactly the same crop */
+bool Benchmark::warpSimd(const char* data_folder, int image_num) {
+	bool passed = true;
+	const char* level_names[] = { "scalar", "AVX2", "NEON" };
+	WarpOptions options;
+	options.setPage(PAGE_A4, 300);
+	printf("SIMD level: %s, crop %dx%d\n", level_names[simdLevel()],
+		options.width, options.height);
+	printf("%-20s %12s %12s %8s %10s\n", "image", "scalar MP/s", "simd MP/s",
+		"speedup", "identical");
+	DocumentDetector detector;
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		CImg<float> img;
+		img.load_bmp(inPath);
+		DetectionResult result = detector.detect(img);
+		if (!result.ok()) continue;
+		options.simd = false;
+		Workspace scalar_workspace, simd_workspace;
+		Warping scalar(img, result.corners, options, &scalar_workspace);
+		options.simd = true;
+		Warping simd(img, result.corners, options, &simd_workspace);
+		double scalar_time = 1e30, simd_time = 1e30;
+		for (int r = 0; r < REPEAT; ++r) {
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			scalar.reverseMapping();
+			scalar_time = std::min(scalar_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			simd.reverseMapping();
+			simd_time = std::min(simd_time, elapsed(start));
+		}
+		double megapixels = 1e-6 * options.width * options.height;
+		bool identical = scalar.dest_img == simd.dest_img;
+		passed = passed && identical;
+		printf("%-20s %12.1f %12.1f %7.2fx %10s\n", inPath,
+			megapixels / scalar_time, megapixels / simd_time,
+			scalar_time / simd_time, identical ? "yes" : "NO");
+	}
+	return passed;
+}
+
+/* Scaling of warping an A4 crop at 300 dpi from 1 thread to all
+*  hardware threads, and whether every thread count gives exactly the
+*  crop of a single thread */
+bool Benchmark::warpThreads(const char* data_folder, int image_num) {
+	bool passed = true;
+	WarpOptions options;
+	options.setPage(PAGE_A4, 300);
+	int max_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<int> thread_nums;
+	for (int t = 1; t < max_threads; t *= 2) thread_nums.push_back(t);
+	thread_nums.push_back(max_threads);
+
+	printf("%-20s %8s %10s %8s %10s\n", "image", "threads", "time(ms)",
+		"speedup", "identical");
+	DocumentDetector detector;
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		CImg<float> img;
+		img.load_bmp(inPath);
+		DetectionResult result = detector.detect(img);
+		if (!result.ok()) continue;
+		Workspace workspace;
+		Warping warping(img, result.corners, options, &workspace);
+		CImg<float> serial_crop;
+		double serial_time = 0;
+		for (size_t t = 0; t < thread_nums.size(); ++t) {
+			warping.options.threads = thread_nums[t];
+			double time = 1e30;
+			for (int r = 0; r < REPEAT; ++r) {
+				std::chrono::steady_clock::time_point start =
+					std::chrono::steady_clock::now();
+				warping.reverseMapping();
+				time = std::min(time, elapsed(start));
+			}
+			if (t == 0) {
+				serial_time = time;
+				serial_crop = warping.dest_img; // a copy, not a view
+			}
+			bool identical = warping.dest_img == serial_crop;
+			passed = passed && identical;
+			printf("%-20s %8d %10.3f %7.2fx %10s\n", inPath, thread_nums[t],
+				time * 1000, serial_time / time, identical ? "yes" : "NO");
+		}
+	}
+	return passed;
+}
+
+/* Time of a whole warping (interleaving the source and sampling) and
+*  output megapixels per second for several page formats */
+void Benchmark::warpSizes(const char* data_folder, int image_num) {
+	const char* names[] = { "demo", "A5 300dpi", "Letter 300dpi",
+		"A4 300dpi", "A4 600dpi" };
+	std::vector<WarpOptions> formats(5);
+	formats[1].setPage(PAGE_A5, 300);
+	formats[2].setPage(PAGE_LETTER, 300);
+	formats[3].setPage(PAGE_A4, 300);
+	formats[4].setPage(PAGE_A4, 600);
+	printf("%-20s %-14s %11s %10s %8s\n", "image", "page", "size",
+		"time(ms)", "MP/s");
+	DocumentDetector detector;
+	Workspace workspace; // grows to the largest crop in the first run
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		CImg<float> img;
+		img.load_bmp(inPath);
+		DetectionResult result = detector.detect(img);
+		if (!result.ok()) continue;
+		for (size_t f = 0; f < formats.size(); ++f) {
+			double time = 1e30;
+			for (int r = 0; r < REPEAT; ++r) {
+				std::chrono::steady_clock::time_point start =
+					std::chrono::steady_clock::now();
+				Warping warping(img, result.corners, formats[f], &workspace);
+				time = std::min(time, elapsed(start));
+			}
+			char size[24];
+			sprintf(size, "%dx%d", formats[f].width, formats[f].height);
+			printf("%-20s %-14s %11s %10.3f %8.1f\n", inPath, names[f], size,
+				time * 1000, 1e-6 * formats[f].width * formats[f].height / time);
+		}
+	}
+}
+
+/* Root mean square difference of two images of the same size */
+static double rmsDifference(const CImg<float>& img1, const CImg<float>& img2) {
+	double sum = 0;
+	cimg_foroff(img1, i) sum += (img1[i] - img2[i]) * (img1[i] - img2[i]);
+	return sqrt(sum / img1.size());
+}
+
+/* Crop of a large source into the demo size with FILTER_BILINEAR, with
+*  FILTER_MIPMAP and with the old workaround (shrink the source with
+*  CImg first, then bilinear). Sources are dataset images upscaled
+*  UPSCALE times with sharp edges, so the crop shrinks the paper sheet
+*  a lot and bilinear sampling skips most source pixels. Prints the
+*  time and the RMS error against a reference crop (bilinear at 8 times
+*  the size, then averaged down), which aliasing makes larger. */
+void Benchmark::warpDownsampling(const char* data_folder, int image_num) {
+	const int UPSCALE = 4, SUPERSAMPLE = 8;
+	printf("%-20s %8s %12s %12s %12s %8s %8s %8s\n", "image", "source",
+		"bilinear(ms)", "mipmap(ms)", "shrink(ms)", "rms bil", "rms mip",
+		"rms shr");
+	DocumentDetector detector;
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		CImg<float> img;
+		img.load_bmp(inPath);
+		DetectionResult result = detector.detect(img);
+		if (!result.ok()) continue;
+		CImg<float> large = img.get_resize(img.width() * UPSCALE,
+			img.height() * UPSCALE, 1, 3, 1); // 1: nearest, keeps sharp edges
+		std::vector<Point> corners = result.corners;
+		for (size_t c = 0; c < corners.size(); ++c)
+			corners[c] = Point(corners[c].x * UPSCALE + UPSCALE / 2,
+				corners[c].y * UPSCALE + UPSCALE / 2);
+
+		WarpOptions options, reference_options;
+		reference_options.width = options.width * SUPERSAMPLE;
+		reference_options.height = options.height * SUPERSAMPLE;
+		CImg<float> reference = Warping(large, corners, reference_options)
+			.getCroppedImg().get_resize(options.width, options.height, 1, 3, 2);
+
+		Workspace workspace;
+		double bilinear_time = 1e30, mipmap_time = 1e30, shrink_time = 1e30;
+		double bilinear_rms = 0, mipmap_rms = 0, shrink_rms = 0;
+		for (int r = 0; r < REPEAT; ++r) {
+			options.filter = FILTER_BILINEAR;
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			Warping bilinear(large, corners, options, &workspace);
+			bilinear_time = std::min(bilinear_time, elapsed(start));
+			bilinear_rms = rmsDifference(bilinear.getCroppedImg(), reference);
+
+			options.filter = FILTER_MIPMAP;
+			start = std::chrono::steady_clock::now();
+			Warping mipmap(large, corners, options, &workspace);
+			mipmap_time = std::min(mipmap_time, elapsed(start));
+			mipmap_rms = rmsDifference(mipmap.getCroppedImg(), reference);
+
+			options.filter = FILTER_BILINEAR;
+			start = std::chrono::steady_clock::now();
+			CImg<float> small = large.get_resize(img.width(), img.height(),
+				1, 3, 2); // 2: average of covered pixels
+			Warping shrink(small, result.corners, options, &workspace);
+			shrink_time = std::min(shrink_time, elapsed(start));
+			shrink_rms = rmsDifference(shrink.getCroppedImg(), reference);
+		}
+		char source[24];
+		sprintf(source, "%.1fMP", 1e-6 * large.width() * large.height());
+		printf("%-20s %8s %12.3f %12.3f %12.3f %8.2f %8.2f %8.2f\n", inPath,
+			source, bilinear_time * 1000, mipmap_time * 1000,
+			shrink_time * 1000, bilinear_rms, mipmap_rms, shrink_rms);
+	}
+}
+
+/* Whole warp of an A4 crop at 300 dpi from the float image and from
+*  the 8-bit image, and the difference of the 8-bit crop from the
+*  rounded float crop: it must stay within WARP8_TOLERANCE grey levels.
+*  Also checks that the scalar and the AVX2 8-bit kernels agree. */
+bool Benchmark::warp8Bit(const char* data_folder, int image_num) {
+	bool passed = true;
+	const int WARP8_TOLERANCE = 2;
+	WarpOptions options;
+	options.setPage(PAGE_A4, 300);
+	printf("%-20s %10s %10s %8s %9s %9s %7s %10s\n", "image", "float(ms)",
+		"8-bit(ms)", "speedup", "max diff", "differ", "pass", "identical");
+	DocumentDetector detector;
+	Workspace workspace;
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		CImg<float> img;
+		img.load_bmp(inPath);
+		DetectionResult result = detector.detect(img);
+		if (!result.ok()) continue;
+		CImg<unsigned char> img8(img);
+		double float_time = 1e30, byte_time = 1e30;
+		for (int r = 0; r < REPEAT; ++r) {
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			Warping warping(img, result.corners, options, &workspace);
+			float_time = std::min(float_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			Warping warping8(img8, result.corners, options, &workspace);
+			byte_time = std::min(byte_time, elapsed(start));
+		}
+		const CImg<float>& crop = Warping(img, result.corners, options,
+			&workspace).getCroppedImg();
+		const CImg<unsigned char>& crop8 = Warping(img8, result.corners,
+			options, &workspace).getCroppedImg8();
+		int max_diff = 0;
+		size_t differ = 0;
+		cimg_foroff(crop, k) {
+			int diff = abs((int)(crop[k] + 0.5f) - crop8[k]);
+			max_diff = std::max(max_diff, diff);
+			if (diff) ++differ;
+		}
+		options.simd = false;
+		CImg<unsigned char> scalar = Warping(img8, result.corners, options)
+			.getCroppedImg8();
+		options.simd = true;
+		bool identical = scalar == crop8;
+		passed = passed && max_diff <= WARP8_TOLERANCE && identical;
+		printf("%-20s %10.2f %10.2f %7.2fx %9d %8.2f%% %7s %10s\n", inPath,
+			float_time * 1000, byte_time * 1000, float_time / byte_time,
+			max_diff, 100.0 * differ / crop.size(),
+			max_diff <= WARP8_TOLERANCE ? "yes" : "NO", identical ? "yes" : "NO");
+	}
+	return passed;
+}
+
+/* Whole warp of an A4 crop at 300 dpi without remap cache, on the first
+*  cache miss (the table is allocated and built), on a later miss (the
+*  table of other corners is replaced) and on a hit (pure gather), for
+*  the float and the 8-bit path. The cached float crop is sampled at positions
+*  truncated to 1/256 pixel: it must stay within TOLERANCE grey levels
+*  of the one without cache; the cached 8-bit crop must be exactly the
+*  one without. Last, crops every image again with its corners moved
+*  by one pixel, as by a fixed camera, through a cache with a tolerance
+*  of TOLERANCE pixels, and prints its hits and misses. */
+bool Benchmark::warpCache(const char* data_folder, int image_num) {
+	bool passed = true;
+	const int TOLERANCE = 2;
+	WarpOptions options;
+	options.setPage(PAGE_A4, 300);
+	printf("%-20s %10s %10s %10s %10s %8s %10s %10s %8s %9s %10s\n", "image",
+		"none(ms)", "first(ms)", "miss(ms)", "hit(ms)", "speedup", "none8(ms)",
+		"hit8(ms)", "speedup", "max diff", "identical");
+	DocumentDetector detector;
+	Workspace workspace;
+	RemapCache cache(1), jitter_cache(1, TOLERANCE);
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		CImg<float> img;
+		img.load_bmp(inPath);
+		DetectionResult result = detector.detect(img);
+		if (!result.ok()) continue;
+		CImg<unsigned char> img8(img);
+		std::vector<Point> moved = result.corners;
+		++moved[0].x;
+		double none_time = 1e30, first_time = 1e30, miss_time = 1e30,
+			hit_time = 1e30, none8_time = 1e30, hit8_time = 1e30;
+		for (int r = 0; r < REPEAT; ++r) {
+			options.cache = NULL;
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			Warping none(img, result.corners, options, &workspace);
+			none_time = std::min(none_time, elapsed(start));
+			start = std::chrono::steady_clock::now();
+			Warping none8(img8, result.corners, options, &workspace);
+			none8_time = std::min(none8_time, elapsed(start));
+
+			options.cache = &cache;
+			cache.clear();
+			start = std::chrono::steady_clock::now();
+			Warping first(img, result.corners, options, &workspace);
+			first_time = std::min(first_time, elapsed(start));
+			Warping(img, moved, options, &workspace); // evicts the table
+			start = std::chrono::steady_clock::now();
+			Warping miss(img, result.corners, options, &workspace);
+			miss_time = std::min(miss_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			Warping hit(img, result.corners, options, &workspace);
+			hit_time = std::min(hit_time, elapsed(start));
+			start = std::chrono::steady_clock::now();
+			Warping hit8(img8, result.corners, options, &workspace);
+			hit8_time = std::min(hit8_time, elapsed(start));
+		}
+		options.cache = NULL;
+		CImg<float> crop = Warping(img, result.corners, options).getCroppedImg();
+		CImg<unsigned char> crop8 = Warping(img8, result.corners, options)
+			.getCroppedImg8();
+		options.cache = &cache;
+		float max_diff = (crop - Warping(img, result.corners, options)
+			.getCroppedImg()).abs().max();
+		bool identical = crop8 == Warping(img8, result.corners, options)
+			.getCroppedImg8();
+		passed = passed && max_diff <= TOLERANCE && identical;
+		printf("%-20s %10.2f %10.2f %10.2f %10.2f %7.2fx %10.2f %10.2f %7.2fx %9.4f %10s\n",
+			inPath, none_time * 1000, first_time * 1000, miss_time * 1000,
+			hit_time * 1000,
+			none_time / hit_time, none8_time * 1000, hit8_time * 1000,
+			none8_time / hit8_time, max_diff,
+			max_diff <= TOLERANCE && identical ? "yes" : "NO");
+
+		options.cache = &jitter_cache;
+		std::vector<Point> corners = result.corners;
+		Warping(img, corners, options, &workspace);
+		for (size_t c = 0; c < corners.size(); ++c) ++corners[c].x;
+		Warping(img, corners, options, &workspace);
+	}
+	printf("one pixel moves with tolerance %d: %ld hits, %ld misses\n", TOLERANCE,
+		jitter_cache.hits(), jitter_cache.misses());
+	return passed;
+}
+
+/* Whether two detections found exactly the same corners */
+static bool sameCorners(const std::vector<Point>& corners1,
+	const std::vector<Point>& corners2) {
+	if (corners1.size() != corners2.size()) return false;
+	for (size_t i = 0; i < corners1.size(); ++i)
+		if (corners1[i].x != corners2[i].x || corners1[i].y != corners2[i].y)
+			return false;
+	return true;
+}
+
+/* Gray conversion of the float image by the rgb2gray loop and of the
+*  8-bit image by the scalar and SIMD fixed-point kernels, the largest
+*  difference between the float and the 8-bit gray image, whether both
+*  kernels agree, and whether the detected corners stay the same */
+bool Benchmark::gray8Bit(const char* data_folder, int image_num) {
+	bool passed = true;
+	const char* level_names[] = { "scalar", "AVX2", "NEON" };
+	printf("SIMD level: %s\n", level_names[simdLevel()]);
+	printf("%-20s %10s %10s %10s %8s %10s %10s %8s\n", "image", "float(ms)",
+		"scalar(ms)", "simd(ms)", "speedup", "max diff", "identical",
+		"corners");
+	DocumentDetector detector;
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		CImg<unsigned char> img8;
+		img8.load_bmp(inPath);
+		HoughOptions options;
+		Hough loop, scalar, simd;
+		loop.options = options;
+		loop.init(inPath);
+		options.simd = false;
+		scalar.options = options;
+		scalar.init(img8);
+		options.simd = true;
+		simd.options = options;
+		simd.init(img8);
+		double loop_time = 1e30, scalar_time = 1e30, simd_time = 1e30;
+		for (int r = 0; r < REPEAT; ++r) {
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			loop.rgb2gray();
+			loop_time = std::min(loop_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			scalar.rgb2gray();
+			scalar_time = std::min(scalar_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			simd.rgb2gray();
+			simd_time = std::min(simd_time, elapsed(start));
+		}
+		float max_diff = (loop.gray_img - simd.gray_img).abs().max();
+		bool identical = scalar.gray_img == simd.gray_img;
+		DetectionResult result = detector.detect(CImg<float>(img8));
+		DetectionResult result8 = detector.detect(img8);
+		bool same_corners = result.status == result8.status &&
+			sameCorners(result.corners, result8.corners);
+		passed = passed && identical && same_corners;
+		printf("%-20s %10.3f %10.3f %10.3f %7.2fx %10.4f %10s %8s\n", inPath,
+			loop_time * 1000, scalar_time * 1000, simd_time * 1000,
+			loop_time / simd_time, max_diff, identical ? "yes" : "NO",
+			same_corners ? "same" : "MOVED");
+	}
+	return passed;
+}
+
+/* Blur time of the Deriche filter and of the separable blur with the
+*  scalar kernel on one thread, the SIMD kernel on one thread and on
+*  all threads. Also the largest difference between the two blurred
+*  images, whether the scalar and SIMD kernels agree and whether the
+*  detected corners stay the same. */
+bool Benchmark::blurModes(const char* data_folder, int image_num) {
+	bool passed = true;
+	printf("%-20s %12s %11s %10s %12s %9s %10s %8s\n", "image",
+		"deriche(ms)", "scalar(ms)", "simd(ms)", "threads(ms)", "max diff",
+		"identical", "corners");
+	HoughOptions deriche_options, separable_options;
+	deriche_options.blur = DERICHE_BLUR;
+	separable_options.blur = SEPARABLE_BLUR;
+	DocumentDetector deriche_detector(deriche_options),
+		separable_detector(separable_options);
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		const BlurMode modes[] = { DERICHE_BLUR, SEPARABLE_BLUR,
+			SEPARABLE_BLUR, SEPARABLE_BLUR };
+		const bool simd[] = { true, false, true, true };
+		const int threads[] = { 1, 1, 1, 0 };
+		Hough hough[4];
+		double times[4];
+		for (int m = 0; m < 4; ++m) {
+			HoughOptions options;
+			options.blur = modes[m];
+			options.simd = simd[m];
+			options.threads = threads[m];
+			hough[m].options = options;
+			hough[m].init(inPath);
+			times[m] = 1e30;
+			for (int r = 0; r < REPEAT; ++r) {
+				hough[m].rgb2gray();
+				std::chrono::steady_clock::time_point start =
+					std::chrono::steady_clock::now();
+				hough[m].blur();
+				times[m] = std::min(times[m], elapsed(start));
+			}
+		}
+		float max_diff = (hough[0].gray_img - hough[2].gray_img).abs().max();
+		bool identical = hough[1].gray_img == hough[2].gray_img &&
+			hough[2].gray_img == hough[3].gray_img;
+		CImg<float> img;
+		img.load_bmp(inPath);
+		DetectionResult deriche = deriche_detector.detect(img);
+		DetectionResult separable = separable_detector.detect(img);
+		bool same_corners = deriche.status == separable.status &&
+			sameCorners(deriche.corners, separable.corners);
+		passed = passed && identical && same_corners;
+		printf("%-20s %12.3f %11.3f %10.3f %12.3f %9.4f %10s %8s\n", inPath,
+			times[0] * 1000, times[1] * 1000, times[2] * 1000, times[3] * 1000,
+			max_diff, identical ? "yes" : "NO", same_corners ? "same" : "MOVED");
+	}
+	return passed;
+}
+
+/* Whole detection time of images upscaled UPSCALE times with 1 (no
+*  pyramid) to 4 pyramid levels (pyramid_levels in HoughOptions), and
+*  the largest distance of the corners found with a pyramid from the
+*  ones found without it */
+void Benchmark::pyramidLevels(const char* data_folder, int image_num) {
+	const int UPSCALE = 4, LEVELS = 4;
+	printf("%-20s %10s %11s %11s %11s %11s %9s\n", "image", "size",
+		"levels1(ms)", "levels2(ms)", "levels3(ms)", "levels4(ms)", "max diff");
+	std::vector<DocumentDetector> detectors;
+	for (int l = 1; l <= LEVELS; ++l) {
+		HoughOptions options;
+		options.pyramid_levels = l;
+		detectors.push_back(DocumentDetector(options));
+	}
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		CImg<float> img;
+		img.load_bmp(inPath);
+		CImg<float> large = img.get_resize(img.width() * UPSCALE,
+			img.height() * UPSCALE, 1, 3, 1); // 1: nearest, keeps sharp edges
+		double times[LEVELS];
+		DetectionResult results[LEVELS];
+		for (int l = 0; l < LEVELS; ++l) {
+			times[l] = 1e30;
+			for (int r = 0; r < REPEAT; ++r) {
+				std::chrono::steady_clock::time_point start =
+					std::chrono::steady_clock::now();
+				detectors[l].detect(large, results[l]);
+				times[l] = std::min(times[l], elapsed(start));
+			}
+		}
+		int max_diff = 0;
+		for (int l = 1; l < LEVELS; ++l) {
+			if (results[l].corners.size() != results[0].corners.size()) {
+				max_diff = -1; // different number of corners
+				break;
+			}
+			for (size_t c = 0; c < results[0].corners.size(); ++c)
+				max_diff = std::max(max_diff, std::max(
+					abs(results[l].corners[c].x - results[0].corners[c].x),
+					abs(results[l].corners[c].y - results[0].corners[c].y)));
+		}
+		char size[24];
+		sprintf(size, "%dx%d", large.width(), large.height());
+		printf("%-20s %10s %11.3f %11.3f %11.3f %11.3f %9d\n", inPath, size,
+			times[0] * 1000, times[1] * 1000, times[2] * 1000, times[3] * 1000,
+			max_diff);
+	}
+}
+
+/* Time of rgb2gray, blur and getGradient one after another and of the
+*  fused streamEdges, whether both find exactly the same edge pixels,
+*  and the memory of their intermediate images or rows */
+bool Benchmark::edgeStreaming(const char* data_folder, int image_num) {
+	bool passed = true;
+	printf("%-20s %10s %10s %8s %10s %12s %12s\n", "image", "stages(ms)",
+		"fused(ms)", "speedup", "identical", "images(KB)", "rows(KB)");
+	for (int i = 0; i < image_num; ++i) {
+		char inPath[80];
+		sprintf(inPath, "%s%d.bmp", data_folder, i);
+		Hough stages, fused;
+		stages.init(inPath);
+		fused.init(inPath);
+		double stages_time = 1e30, fused_time = 1e30;
+		for (int r = 0; r < REPEAT; ++r) {
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			stages.rgb2gray();
+			stages.blur();
+			stages.getGradient();
+			stages_time = std::min(stages_time, elapsed(start));
+
+			start = std::chrono::steady_clock::now();
+			fused.streamEdges();
+			fused_time = std::min(fused_time, elapsed(start));
+		}
+		const EdgePoints &e1 = stages.edges, &e2 = fused.edges;
+		bool identical = e1.x == e2.x && e1.y == e2.y &&
+			e1.magnitude == e2.magnitude && e1.direction == e2.direction;
+		size_t images = stages.workspace.gray.capacity() +
+			stages.workspace.blurred.capacity() +
+			stages.workspace.gradients.capacity();
+		passed = passed && identical;
+		printf("%-20s %10.3f %10.3f %7.2fx %10s %12zu %12zu\n", inPath,
+			stages_time * 1000, fused_time * 1000, stages_time / fused_time,
+			identical ? "yes" : "NO", images * sizeof(float) / 1024,
+			fused.workspace.stream_rows.capacity() * sizeof(float) / 1024);
+	}
+	return passed;
+}
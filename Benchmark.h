@@ -0,0 +1,42 @@
+/*
+#  File        : Benchmark.h
+#  Description : Micro-benchmarks of the detection and warping stages
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#pragma once
+#ifndef _Benchmark_
+#define _Benchmark_
+#include "Hough.h"
+#include "Warping.h"
+
+/* Every benchmark takes a dataset folder and the number of images
+*  in it (same as main.cpp) and prints one line per image. Those that
+*  also check results return false if a check failed on any image. */
+class Benchmark {
+private:
+	static const int REPEAT = 5; // runs per image, the best one is reported
+
+	static void prepare(Hough& hough, const char* filePath,
+		HoughOptions options = HoughOptions());
+public:
+	static void houghVoting(const char* data_folder, int image_num);
+	static void houghThreads(const char* data_folder, int image_num);
+	static void houghLayout(const char* data_folder, int image_num);
+	static bool houghSimd(const char* data_folder, int image_num);
+	static bool allocations(const char* data_folder, int image_num);
+	static bool warpSimd(const char* data_folder, int image_num);
+	static bool warpThreads(const char* data_folder, int image_num);
+	static void warpSizes(const char* data_folder, int image_num);
+	static void warpDownsampling(const char* data_folder, int image_num);
+	static bool warp8Bit(const char* data_folder, int image_num);
+	static bool warpCache(const char* data_folder, int image_num);
+	static bool gray8Bit(const char* data_folder, int image_num);
+	static bool blurModes(const char* data_folder, int image_num);
+	static bool edgeStreaming(const char* data_folder, int image_num);
+	static void pyramidLevels(const char* data_folder, int image_num);
+};
+
+#endif
@@ -0,0 +1,49 @@
+/*
+#  File        : DocumentDetector.cpp
+#  Description : Headless paper sheet detection API
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#include "DocumentDetector.h"
+
+DocumentDetector::DocumentDetector(HoughOptions options) {
+	hough.options = options;
+}
+
+/* Detect the paper sheet in an RGB image */
+DetectionResult DocumentDetector::detect(const CImg<float>& rgb_img) {
+	DetectionResult result;
+	detect(rgb_img, result);
+	return result;
+}
+
+/* Detect into result, assign keeps the capacity of its vectors */
+void DocumentDetector::detect(const CImg<float>& rgb_img,
+	DetectionResult& result) {
+	hough.init(rgb_img);
+	getResult(result);
+}
+
+DetectionResult DocumentDetector::detect(const CImg<unsigned char>& rgb_img) {
+	DetectionResult result;
+	detect(rgb_img, result);
+	return result;
+}
+
+void DocumentDetector::detect(const CImg<unsigned char>& rgb_img,
+	DetectionResult& result) {
+	hough.init(rgb_img);
+	getResult(result);
+}
+
+/* Detect on the image given to hough.init */
+void DocumentDetector::getResult(DetectionResult& result) {
+	result.status = hough.detect(false);
+	result.corners.assign(hough.ordered_corners.begin(),
+		hough.ordered_corners.end());
+	result.lines.assign(hough.lines.begin(), hough.lines.end());
+	result.confidence = hough.confidence;
+	result.timings = hough.timings;
+}
@@ -0,0 +1,46 @@
+/*
+#  File        : DocumentDetector.h
+#  Description : Headless paper sheet detection API
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#pragma once
+#ifndef _DocumentDetector_
+#define _DocumentDetector_
+#include "Hough.h"
+
+struct DetectionResult {
+	DetectionStatus status; // the other fields are valid only if OK
+	// in the order of top-left, top-right, bottom-left, bottom-right
+	std::vector<Point> corners;
+	std::vector<Line> lines; // four edges in parameter space
+	float confidence; // in [0, 1], weakest edge support, see Hough.cpp
+	StageTimings timings;
+	DetectionResult() : status(DETECTION_OK), confidence(0) {}
+	bool ok() const { return status == DETECTION_OK; }
+};
+
+/* Detect paper sheets in images without any display or console
+*  output. One detector can be reused for many images, a failed
+*  detection is reported in the result and does not stop anything.
+*  The detector keeps the buffers of every stage (see Workspace.h),
+*  so use one detector per thread. */
+class DocumentDetector {
+private:
+	Hough hough;
+	void getResult(DetectionResult& result);
+public:
+	DocumentDetector(HoughOptions options = HoughOptions());
+	DetectionResult detect(const CImg<float>& rgb_img);
+	// same, into a result reused for many images: once the buffers
+	// have grown to the image size, this does not allocate at all
+	void detect(const CImg<float>& rgb_img, DetectionResult& result);
+	// same for an image loaded as CImg<unsigned char>: no float copy is
+	// made, its gray image is computed from the bytes (see rgb2gray)
+	DetectionResult detect(const CImg<unsigned char>& rgb_img);
+	void detect(const CImg<unsigned char>& rgb_img, DetectionResult& result);
+};
+
+#endif
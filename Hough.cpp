@@ -9,6 +9,8 @@
 #include "Hough.h"
 #include<cmath>
 #include<algorithm>
+#include<chrono>
+#include<thread>
 
 /* Compare function for HoughEdge sort.
 The strongest edge rank first. */
@@ -35,76 +37,1090 @@ bool cmp_lines(Line l1, Line l2) {
 	return l1.m < l2.m;
 }
 
-/* Constructor */
-Hough::Hough(char* filePath) {
-	// init
-	rgb_img.load_bmp(filePath);
-	w = rgb_img.width();
-	h = rgb_img.height();
-	gray_img = gradients = CImg<double>(w, h, 1, 1, 0);
-	hough_space = CImg<double>(360, distance(w, h), 1, 1, 0);
+/* Add partial_num accumulators of size cells each, stored one after
+*  another in partial, to dst in the range [first, last).
+*  Plain contiguous loops so that the compiler can vectorise them. */
+template<typename T>
+static void addAccumulators(T* dst, const T* partial, int partial_num,
+	size_t size, size_t first, size_t last) {
+	for (int i = 0; i < partial_num; ++i) {
+		const T* src = partial + i * size;
+		for (size_t j = first; j < last; ++j) dst[j] += src[j];
+	}
+}
+
+/* Order 0 Deriche filter along n samples off apart, with the
+*  coefficients and Neumann boundaries of CImg::deriche, in the same
+*  float operations, so it blurs exactly like CImg::blur. line holds
+*  the n causal outputs, so the filter does not allocate. */
+static void dericheLine(float* ptr, int n, size_t off, const float* coef,
+	float* line) {
+	const float a0 = coef[0], a1 = coef[1], a2 = coef[2], a3 = coef[3],
+		b1 = coef[4], b2 = coef[5], coefp = coef[6], coefn = coef[7];
+	float* ptr_line = line;
+	float xp = *ptr, yb = coefp*xp, yp = yb;
+	for (int i = 0; i < n; ++i) {
+		const float xc = *ptr; ptr += off;
+		const float yc = *(ptr_line++) = a0*xc + a1*xp - b1*yp - b2*yb;
+		xp = xc; yb = yp; yp = yc;
+	}
+	float xn = *(ptr - off), xa = xn, yn = coefn*xn, ya = yn;
+	for (int i = n - 1; i >= 0; --i) {
+		const float xc = *(ptr -= off);
+		const float yc = a2*xn + a3*xa - b1*yn - b2*ya;
+		xa = xn; xn = xc; ya = yn; yn = yc;
+		*ptr = *(--ptr_line) + yc;
+	}
+}
+
+// the kernels down to weightedSumNeon must give the same rows, gray
+// values and sums in every version, so none of them uses FMAs
+SIMD_NO_FMA_BEGIN
+
+/* rows[i] = offset + (int)(x * cos_t[i] + y * sin_t[i]) for i < n.
+*  The SIMD versions do the same double multiplies, add and truncation
+*  per lane, so they give exactly the same rows as the scalar one. */
+static void rhoRowsScalar(const double* cos_t, const double* sin_t,
+	int x, int y, int offset, int n, int* rows) {
+	for (int i = 0; i < n; ++i)
+		rows[i] = offset + (int)(x*cos_t[i] + y*sin_t[i]);
+}
+
+#ifdef USE_X86_SIMD
+SIMD_TARGET_AVX2
+static void rhoRowsAvx2(const double* cos_t, const double* sin_t,
+	int x, int y, int offset, int n, int* rows) {
+	__m256d vx = _mm256_set1_pd(x), vy = _mm256_set1_pd(y);
+	__m128i voffset = _mm_set1_epi32(offset);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) { // 8 angles, two registers of 4 doubles
+		__m256d rho0 = _mm256_add_pd(
+			_mm256_mul_pd(vx, _mm256_loadu_pd(cos_t + i)),
+			_mm256_mul_pd(vy, _mm256_loadu_pd(sin_t + i)));
+		__m256d rho1 = _mm256_add_pd(
+			_mm256_mul_pd(vx, _mm256_loadu_pd(cos_t + i + 4)),
+			_mm256_mul_pd(vy, _mm256_loadu_pd(sin_t + i + 4)));
+		_mm_storeu_si128((__m128i*)(rows + i),
+			_mm_add_epi32(voffset, _mm256_cvttpd_epi32(rho0)));
+		_mm_storeu_si128((__m128i*)(rows + i + 4),
+			_mm_add_epi32(voffset, _mm256_cvttpd_epi32(rho1)));
+	}
+	rhoRowsScalar(cos_t + i, sin_t + i, x, y, offset, n - i, rows + i);
+}
+#endif
+
+#ifdef USE_NEON_SIMD
+static void rhoRowsNeon(const double* cos_t, const double* sin_t,
+	int x, int y, int offset, int n, int* rows) {
+	float64x2_t vx = vdupq_n_f64(x), vy = vdupq_n_f64(y);
+	int32x4_t voffset = vdupq_n_s32(offset);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) { // 4 angles, two registers of 2 doubles
+		float64x2_t rho0 = vaddq_f64(vmulq_f64(vx, vld1q_f64(cos_t + i)),
+			vmulq_f64(vy, vld1q_f64(sin_t + i)));
+		float64x2_t rho1 = vaddq_f64(vmulq_f64(vx, vld1q_f64(cos_t + i + 2)),
+			vmulq_f64(vy, vld1q_f64(sin_t + i + 2)));
+		int32x4_t rho = vcombine_s32(vmovn_s64(vcvtq_s64_f64(rho0)),
+			vmovn_s64(vcvtq_s64_f64(rho1)));
+		vst1q_s32(rows + i, vaddq_s32(voffset, rho));
+	}
+	rhoRowsScalar(cos_t + i, sin_t + i, x, y, offset, n - i, rows + i);
+}
+#endif
+
+/* Luma weights of 0.299, 0.587 and 0.114 in 1/32768: they add up to
+*  32768 (white stays 255) and fit in 16-bit multiplies */
+static const int GRAY_R = 9798, GRAY_G = 19235, GRAY_B = 3735;
+static const float GRAY_SCALE = 1.0f / 32768;
+
+/* gray[i] = luma of the 8-bit pixel (r[i], g[i], b[i]) for i < n in
+*  fixed point. The sum is below 2^24, so converting it to float and
+*  scaling by a power of two is exact and every version gives exactly
+*  the same gray values. */
+static void grayRowScalar(const unsigned char* r, const unsigned char* g,
+	const unsigned char* b, size_t n, float* gray) {
+	for (size_t i = 0; i < n; ++i)
+		gray[i] = (GRAY_R * r[i] + GRAY_G * g[i] + GRAY_B * b[i]) * GRAY_SCALE;
+}
+
+#ifdef USE_SSE2_SIMD
+/* 8 pixels per loop: red and green 16-bit lanes are interleaved so
+*  that one multiply-add gives r * GRAY_R + g * GRAY_G per pixel */
+static void grayRowSse2(const unsigned char* r, const unsigned char* g,
+	const unsigned char* b, size_t n, float* gray) {
+	const __m128i zero = _mm_setzero_si128(),
+		weights_rg = _mm_set1_epi32(GRAY_R | (GRAY_G << 16)),
+		weights_b = _mm_set1_epi32(GRAY_B);
+	const __m128 scale = _mm_set1_ps(GRAY_SCALE);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i r16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r + i)), zero);
+		__m128i g16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(g + i)), zero);
+		__m128i b16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(b + i)), zero);
+		__m128i lo = _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpacklo_epi16(r16, g16), weights_rg),
+			_mm_madd_epi16(_mm_unpacklo_epi16(b16, zero), weights_b));
+		__m128i hi = _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpackhi_epi16(r16, g16), weights_rg),
+			_mm_madd_epi16(_mm_unpackhi_epi16(b16, zero), weights_b));
+		_mm_storeu_ps(gray + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(gray + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	grayRowScalar(r + i, g + i, b + i, n - i, gray + i);
+}
+#endif
+
+#ifdef USE_X86_SIMD
+/* grayRowSse2 on 16 pixels per loop. Unpacking works within 128-bit
+*  halves, so the sums come out as pixels 0-3, 8-11 and 4-7, 12-15 and
+*  are put back in order before the store. */
+SIMD_TARGET_AVX2
+static void grayRowAvx2(const unsigned char* r, const unsigned char* g,
+	const unsigned char* b, size_t n, float* gray) {
+	const __m256i zero = _mm256_setzero_si256(),
+		weights_rg = _mm256_set1_epi32(GRAY_R | (GRAY_G << 16)),
+		weights_b = _mm256_set1_epi32(GRAY_B);
+	const __m256 scale = _mm256_set1_ps(GRAY_SCALE);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i r16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(r + i)));
+		__m256i g16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(g + i)));
+		__m256i b16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+		__m256i lo = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(r16, g16), weights_rg),
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(b16, zero), weights_b));
+		__m256i hi = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(r16, g16), weights_rg),
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(b16, zero), weights_b));
+		__m256i first = _mm256_permute2x128_si256(lo, hi, 0x20);
+		__m256i second = _mm256_permute2x128_si256(lo, hi, 0x31);
+		_mm256_storeu_ps(gray + i, _mm256_mul_ps(_mm256_cvtepi32_ps(first), scale));
+		_mm256_storeu_ps(gray + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(second), scale));
+	}
+	grayRowScalar(r + i, g + i, b + i, n - i, gray + i);
+}
+#endif
+
+#ifdef USE_NEON_SIMD
+static void grayRowNeon(const unsigned char* r, const unsigned char* g,
+	const unsigned char* b, size_t n, float* gray) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) { // 8 pixels, two registers of 4 sums
+		uint16x8_t r16 = vmovl_u8(vld1_u8(r + i)), g16 = vmovl_u8(vld1_u8(g + i)),
+			b16 = vmovl_u8(vld1_u8(b + i));
+		uint32x4_t lo = vmull_n_u16(vget_low_u16(r16), GRAY_R);
+		lo = vmlal_n_u16(lo, vget_low_u16(g16), GRAY_G);
+		lo = vmlal_n_u16(lo, vget_low_u16(b16), GRAY_B);
+		uint32x4_t hi = vmull_n_u16(vget_high_u16(r16), GRAY_R);
+		hi = vmlal_n_u16(hi, vget_high_u16(g16), GRAY_G);
+		hi = vmlal_n_u16(hi, vget_high_u16(b16), GRAY_B);
+		vst1q_f32(gray + i, vmulq_n_f32(vcvtq_f32_u32(lo), GRAY_SCALE));
+		vst1q_f32(gray + i + 4, vmulq_n_f32(vcvtq_f32_u32(hi), GRAY_SCALE));
+	}
+	grayRowScalar(r + i, g + i, b + i, n - i, gray + i);
+}
+#endif
+
+/* out[i] = sum of weights[k] * src[k][i] over the taps k, for i in
+*  [first, n). Added in the order of k without fused multiply-add, so
+*  the SIMD versions give exactly the same sums. */
+static void weightedSumScalar(const float* const* src, const float* weights,
+	int taps, int first, int n, float* out) {
+	for (int i = first; i < n; ++i) {
+		float sum = weights[0] * src[0][i];
+		for (int k = 1; k < taps; ++k) sum += weights[k] * src[k][i];
+		out[i] = sum;
+	}
+}
+
+#ifdef USE_SSE2_SIMD
+/* 8 outputs per loop in two registers of 4 */
+static void weightedSumSse2(const float* const* src, const float* weights,
+	int taps, int first, int n, float* out) {
+	int i = first;
+	for (; i + 8 <= n; i += 8) {
+		__m128 weight = _mm_set1_ps(weights[0]);
+		__m128 lo = _mm_mul_ps(weight, _mm_loadu_ps(src[0] + i));
+		__m128 hi = _mm_mul_ps(weight, _mm_loadu_ps(src[0] + i + 4));
+		for (int k = 1; k < taps; ++k) {
+			weight = _mm_set1_ps(weights[k]);
+			lo = _mm_add_ps(lo, _mm_mul_ps(weight, _mm_loadu_ps(src[k] + i)));
+			hi = _mm_add_ps(hi, _mm_mul_ps(weight, _mm_loadu_ps(src[k] + i + 4)));
+		}
+		_mm_storeu_ps(out + i, lo);
+		_mm_storeu_ps(out + i + 4, hi);
+	}
+	weightedSumScalar(src, weights, taps, i, n, out);
+}
+#endif
+
+#ifdef USE_X86_SIMD
+SIMD_TARGET_AVX2
+static void weightedSumAvx2(const float* const* src, const float* weights,
+	int taps, int first, int n, float* out) {
+	int i = first;
+	for (; i + 8 <= n; i += 8) {
+		__m256 sum = _mm256_mul_ps(_mm256_set1_ps(weights[0]),
+			_mm256_loadu_ps(src[0] + i));
+		for (int k = 1; k < taps; ++k)
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]),
+				_mm256_loadu_ps(src[k] + i)));
+		_mm256_storeu_ps(out + i, sum);
+	}
+	weightedSumScalar(src, weights, taps, i, n, out);
+}
+#endif
+
+#ifdef USE_NEON_SIMD
+static void weightedSumNeon(const float* const* src, const float* weights,
+	int taps, int first, int n, float* out) {
+	int i = first;
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t sum = vmulq_n_f32(vld1q_f32(src[0] + i), weights[0]);
+		for (int k = 1; k < taps; ++k) // not vfmaq: no fused multiply-add
+			sum = vaddq_f32(sum, vmulq_n_f32(vld1q_f32(src[k] + i), weights[k]));
+		vst1q_f32(out + i, sum);
+	}
+	weightedSumScalar(src, weights, taps, i, n, out);
+}
+#endif
+
+SIMD_NO_FMA_END
+
+/* Milliseconds elapsed since start */
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+/* Constructor. Detect, display intermediate results and
+*  print lines like the headless DocumentDetector does not */
+Hough::Hough(char* filePath, HoughOptions _options) : options(_options) {
+	init(filePath);
+	detect(true);
+}
+
+/* Run every detection stage on rgb_img and time them.
+*  Display intermediate results and print progress if verbose. */
+DetectionStatus Hough::detect(bool _verbose) {
+	verbose = _verbose;
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now(), stage = start;
+	if (options.pyramid_levels > 1) {
+		// runs findEdges on the full resolution image itself
+		status = getPyramidHoughEdges();
+		timings.hough = elapsedMs(stage) - timings.gray - timings.blur
+			- timings.gradient;
+		timings.edges = 0; // included in hough
+	}
+	else {
+		findEdges();
+		stage = std::chrono::steady_clock::now();
+		houghTransform();
+		timings.hough = elapsedMs(stage);
+		if (verbose) getHoughSpaceImg().display();// .save("dataset1/hough_space.bmp");
+		stage = std::chrono::steady_clock::now();
+		status = getHoughEdges();
+		timings.edges = elapsedMs(stage);
+		if (verbose) getHoughSpaceImg().display();// .save("dataset1/hough_space2.bmp");
+	}
+	if (status == DETECTION_OK) {
+		stage = std::chrono::steady_clock::now();
+		getLines();
+		getCorners();
+		getConfidence();
+		status = orderCorners();
+		if (status == DETECTION_OK) mapToSource();
+		timings.corners = elapsedMs(stage);
+	}
+	timings.total = timings.init + elapsedMs(start); // init ran before
+	if (status != DETECTION_OK) {
+		if (verbose) std::cout << detectionStatusMessage(status) << std::endl;
+		return status;
+	}
+	if (verbose) displayCornersAndLines();
+	return status;
+}
 
+/* Strong edge pixels of rgb_img by rgb2gray, blur and getGradient, or
+*  by streamEdges, and the time of these stages */
+void Hough::findEdges() {
+	std::chrono::steady_clock::time_point stage =
+		std::chrono::steady_clock::now();
+	if (fused()) {
+		streamEdges();
+		timings.gradient = elapsedMs(stage);
+		timings.gray = timings.blur = 0; // included in gradient
+		return;
+	}
 	rgb2gray();
-	gray_img.blur(BLUR_SIGMA).display();// .save("dataset1/blur.bmp");
+	timings.gray = elapsedMs(stage);
+	stage = std::chrono::steady_clock::now();
+	blur();
+	timings.blur = elapsedMs(stage);
+	if (verbose) gray_img.display();// .save("dataset1/blur.bmp");
+	stage = std::chrono::steady_clock::now();
 	getGradient();
-	gradients.display();// .save("dataset1/gradient.bmp");
-	houghTransform();
-	hough_space.display();// .save("dataset1/hough_space.bmp");
-	getHoughEdges();
-	hough_space.display();// .save("dataset1/hough_space2.bmp");
-	getLines();
-	getCorners();
-	orderCorners();
-	displayCornersAndLines();
+	timings.gradient = elapsedMs(stage);
+	if (verbose) gradients.display();// .save("dataset1/gradient.bmp");
+}
+
+/* Error message of a failed detection */
+const char* detectionStatusMessage(DetectionStatus status) {
+	switch (status) {
+	case DETECTION_OK:
+		return "OK";
+	case TOO_FEW_EDGES:
+		return "ERROR: Please set parameter Q larger in file "
+			"'Hough.h' to filter out four edges!";
+	case EDGE_FILTER_FAILED:
+		return "ERROR: Bug in function void Hough::filterHoughEdges()! "
+			"Please check the ifelse statement to filter out four hough_edges.";
+	case TOO_FEW_CORNERS:
+		return "ERROR: Can not detect four ordered_corners in function "
+			"void Hough::orderCorners(). Please try to adjust parameters.";
+	case DEGENERATE_CORNERS:
+		return "ERROR: The four edges found in function void Hough::getCorners() "
+			"do not form a quadrilateral. Please try a larger detection_scale.";
+	}
+	return "ERROR: Unknown detection status.";
+}
+
+/* Load source image and allocate buffers of every stage */
+void Hough::init(const char* filePath) {
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	rgb8_img.assign();
+	rgb_img.assign(); // may be a view of the workspace
+	rgb_img.load_bmp(filePath);
+	initSource();
+	timings.init = elapsedMs(start); // after initBuffers reset timings
+}
+
+/* Use a copy of img as source image and allocate buffers */
+void Hough::init(const CImg<float>& img) {
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	rgb8_img.assign();
+	workspace.rgb.bind(rgb_img, img.width(), img.height(), 1, img.spectrum());
+	std::copy(img.data(), img.data() + img.size(), rgb_img.data());
+	initSource();
+	timings.init = elapsedMs(start);
+}
+
+/* Detect on a view of an 8-bit image: rgb2gray and the pyramid read
+*  its bytes and there is no float copy of it, so getRGBImg() is empty.
+*  The proxy resizes a float image, with it img is copied to one. */
+void Hough::init(const CImg<unsigned char>& img) {
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	if (options.detection_scale < 1) {
+		rgb8_img.assign();
+		workspace.rgb.bind(rgb_img, img.width(), img.height(), 1, img.spectrum());
+		std::copy(img.data(), img.data() + img.size(), rgb_img.data());
+		initSource();
+	}
+	else {
+		rgb8_img.assign(img, true); // only read
+		rgb_img.assign(); // may be a view of the workspace or a proxy
+		source_img.assign();
+		initBuffers();
+	}
+	timings.init = elapsedMs(start);
+}
+
+/* With detection_scale < 1, detection runs on a downscaled proxy
+*  (rgb_img) and the full resolution image is kept in source_img. Every
+*  proxy pixel is the average of a block of source_factor x
+*  source_factor pixels, the whole number nearest to 1 / detection_scale
+*  that leaves MIN_PROXY_SIZE pixels on the smaller side. */
+void Hough::initSource() {
+	source_factor = 1;
+	if (options.detection_scale < 1) {
+		source_factor = std::max(1, (int)(1 / options.detection_scale + 0.5));
+		// too small proxies lose the edges
+		while (source_factor > 1 && std::min(rgb_img.width(), rgb_img.height())
+			/ source_factor < MIN_PROXY_SIZE)
+			--source_factor;
+	}
+	if (source_factor > 1) {
+		source_img.swap(rgb_img);
+		rgb_img.assign(); // drop the old proxy or workspace view
+		workspace.proxy.bind(rgb_img, source_img.width() / source_factor,
+			source_img.height() / source_factor, 1, 3);
+		shrinkImage(source_img.data(), source_img.width(), source_img.height(),
+			source_img.spectrum(), source_factor, rgb_img.data());
+	}
+	else {
+		source_img.assign();
+	}
+	initBuffers();
+}
+
+/* Map lines found on the proxy back to source_img, the corners are
+*  mapped by orderCorners */
+void Hough::mapToSource() {
+	if (source_img.is_empty()) return;
+	for (size_t i = 0; i < lines.size(); ++i) { // m stays the same
+		lines[i].b *= source_factor;
+		lines[i].dist_o *= source_factor;
+		lines[i].x0 *= source_factor;
+		lines[i].y0 *= source_factor;
+		lines[i].x1 *= source_factor;
+		lines[i].y1 *= source_factor;
+	}
+}
+
+/* Pixel of source_img at the center of proxy pixel p, p itself if
+*  there is no proxy */
+Point Hough::toSource(const Point& p) const {
+	if (source_img.is_empty()) return p;
+	return Point(std::min(source_img.width() - 1,
+		p.x * source_factor + source_factor / 2),
+		std::min(source_img.height() - 1, p.y * source_factor + source_factor / 2));
+}
+
+/* Take buffers of every stage for rgb_img from the workspace */
+void Hough::initBuffers() {
+	w = rgb8_img.is_empty() ? rgb_img.width() : rgb8_img.width();
+	h = rgb8_img.is_empty() ? rgb_img.height() : rgb8_img.height();
+	// gray_img and gradients are bound by the stages writing them, so
+	// streamEdges never takes memory for them
+	edges.clear();
+	hough_edges.clear();
+	lines.clear();
+	corners.clear();
+	ordered_corners.clear();
+	confidence = 0;
+	status = DETECTION_OK;
+	timings = StageTimings();
+	pixel_scale = source_img.is_empty() ? 1 : 1.0f / source_factor;
+	trig = &TrigTable::get();
+	rho_kernel = rhoRowsScalar;
+	gray_kernel = grayRowScalar;
+	sum_kernel = weightedSumScalar;
+	if (options.simd) {
+#ifdef USE_SSE2_SIMD
+		gray_kernel = grayRowSse2;
+		sum_kernel = weightedSumSse2;
+#endif
+#ifdef USE_X86_SIMD
+		if (simdLevel() == SIMD_AVX2) {
+			rho_kernel = rhoRowsAvx2;
+			gray_kernel = grayRowAvx2;
+			sum_kernel = weightedSumAvx2;
+		}
+#endif
+#ifdef USE_NEON_SIMD
+		rho_kernel = rhoRowsNeon;
+		gray_kernel = grayRowNeon;
+		sum_kernel = weightedSumNeon;
+#endif
+	}
+	rho_num = distance(w, h);
+	if (options.accumulator == HALF_RANGE) {
+		// theta in [0, 180) and x, y >= 0 so rho >= -w
+		angle_num = 180;
+		rho_offset = w;
+		rho_rows = rho_offset + rho_num;
+	}
+	else {
+		angle_num = 360;
+		rho_offset = 0;
+		rho_rows = rho_num;
+	}
+	// a window (one per side in FULL_RANGE) covers at most 179 of the
+	// 180 angles of a half turn, so windows never wrap onto themselves
+	// or each other and a pixel votes at most once for every cell
+	options.angle_window = std::max(0, std::min(options.angle_window, 180 / 2 - 1));
+	if (options.layout == RHO_CONTIGUOUS) {
+		angle_stride = rho_rows;
+		row_stride = 1;
+	}
+	else {
+		angle_stride = 1;
+		row_stride = angle_num;
+	}
+	// bound by houghTransform once the number of edges is known
+	hough_space16.assign();
+	hough_space32.assign();
+}
+
+/* Hough space as a float image with angle along x, for display */
+CImg<float> Hough::getHoughSpaceImg() {
+	CImg<float> img;
+	if (!hough_space16.is_empty()) img = hough_space16;
+	else img = hough_space32;
+	if (options.layout == RHO_CONTIGUOUS) img.transpose();
+	return img;
+}
+
+/* Accumulator cell of (angle, row) in the layout of options */
+template<typename T>
+inline T& Hough::houghCell(CImg<T>& space, int angle, int row) {
+	return space[(size_t)angle * angle_stride + (size_t)row * row_stride];
+}
+
+/* Votes of line (angle, rho) in the shifted 360 degree hough space
+*  (see houghTransform) whatever the accumulator mode is.
+*  In HALF_RANGE mode, angle in [180, 360) is stored as is with
+*  positive rho, angle in [0, 180) is the opposite normal direction
+*  and stored with negative rho. Return NULL if the line can not
+*  get any vote (rho < -w is not stored). */
+template<typename T>
+T* Hough::houghVotes(CImg<T>& space, int angle, int rho) {
+	if (options.accumulator == FULL_RANGE)
+		return &houghCell(space, angle, rho);
+	if (angle >= 180)
+		return &houghCell(space, angle - 180, rho_offset + rho);
+	if (rho > rho_offset)
+		return NULL;
+	return &houghCell(space, angle, rho_offset - rho);
 }
 
 /* Euclidean distance / Pythagorean Theorem */
+/* A distance of the given full resolution pixels in pixels of rgb_img,
+*  which may be a proxy or a pyramid level */
+int Hough::scaled(int pixels) const {
+	return std::max(1, (int)(pixels * pixel_scale + 0.5f));
+}
+
 float Hough::distance(float diff_x, float diff_y) {
 	return sqrt(diff_x * diff_x + diff_y * diff_y);
 }
 
 /* RGB to grayscale transformation */
 void Hough::rgb2gray() {
-	cimg_forXY(rgb_img, x, y) {
-		int r = rgb_img(x, y, 0);
-		int g = rgb_img(x, y, 1);
-		int b = rgb_img(x, y, 2);
-		gray_img(x, y) = 0.299 * r + 0.587 * g + 0.114 * b;
+	workspace.gray.bind(gray_img, w, h); // completely written
+	grayPixels(0, (size_t)w * h, gray_img.data());
+}
+
+/* Gray values of the n pixels from pixel offset first on (row by row)
+*  of the image detected on. The planes of an 8-bit image are converted
+*  by gray_kernel. */
+void Hough::grayPixels(size_t first, size_t n, float* gray) {
+	if (!rgb8_img.is_empty()) {
+		gray_kernel(rgb8_img.data(0, 0, 0, 0) + first,
+			rgb8_img.data(0, 0, 0, 1) + first,
+			rgb8_img.data(0, 0, 0, 2) + first, n, gray);
+		return;
+	}
+	const float *rs = rgb_img.data(0, 0, 0, 0) + first,
+		*gs = rgb_img.data(0, 0, 0, 1) + first,
+		*bs = rgb_img.data(0, 0, 0, 2) + first;
+	for (size_t i = 0; i < n; ++i) {
+		int r = rs[i];
+		int g = gs[i];
+		int b = bs[i];
+		gray[i] = 0.299 * r + 0.587 * g + 0.114 * b;
+	}
+}
+
+/* Blur gray_img like gray_img.blur(BLUR_SIGMA) does (CImg::deriche
+*  along x then y), without its per line allocation, or with the
+*  separable Gaussian, see BlurMode */
+void Hough::blur() {
+	if (options.blur == SEPARABLE_BLUR) {
+		blurSeparable();
+		return;
 	}
+	float coef[8];
+	dericheCoefficients(coef);
+	float* line = workspace.blur_line.reserve(std::max(w, h));
+	if (w > 1) for (int y = 0; y < h; ++y)
+		dericheLine(gray_img.data(0, y), w, 1, coef, line);
+	if (h > 1) for (int x = 0; x < w; ++x)
+		dericheLine(gray_img.data(x, 0), h, w, coef, line);
+}
+
+/* Coefficients of the order 0 Deriche filter of BLUR_SIGMA, in the
+*  order dericheLine takes them */
+void Hough::dericheCoefficients(float* coef) {
+	const float alpha = 1.695f / BLUR_SIGMA,
+		ema = (float)std::exp(-alpha),
+		ema2 = (float)std::exp(-2 * alpha),
+		b1 = -2 * ema,
+		b2 = ema2,
+		k = (1 - ema)*(1 - ema) / (1 + 2 * alpha*ema - ema2),
+		a0 = k,
+		a1 = k*(alpha - 1)*ema,
+		a2 = k*(alpha + 1)*ema,
+		a3 = -k*ema2;
+	const float c[] = { a0, a1, a2, a3, b1, b2,
+		(a0 + a1) / (1 + b1 + b2), (a2 + a3) / (1 + b1 + b2) };
+	std::copy(c, c + 8, coef);
 }
 
-/* get intensity gradient magnitude for edge detection */
+/* Blur of gray_img with 2 * BLUR_RADIUS + 1 taps: the response of
+*  dericheLine to an impulse, in 1/65536 (rounded, then the center one
+*  corrects their sum to 65536). Each
+*  output row is the weighted sum of the input rows around it, then
+*  the weighted sum of its shifted copies, both by sum_kernel. Borders
+*  repeat the edge pixels like the Neumann boundaries of CImg. Blocks
+*  of rows run on the thread pool, each with its own line. The result
+*  goes to workspace.blurred, which then becomes the gray buffer. */
+void Hough::blurSeparable() {
+	const int TAPS = 2 * BLUR_RADIUS + 1;
+	float weights[TAPS];
+	blurWeights(weights);
+	int thread_num = rowThreadNum(h);
+	const int line_size = w + 2 * BLUR_RADIUS;
+	float* lines = workspace.blur_line.reserve((size_t)thread_num * line_size);
+	float* out = workspace.blurred.reserve((size_t)w * h);
+	const float* in = gray_img.data();
+	auto blurRows = [&](int t) {
+		float* line = lines + (size_t)t * line_size;
+		const float* src[TAPS];
+		for (int y = h * t / thread_num; y < h * (t + 1) / thread_num; ++y) {
+			for (int k = 0; k < TAPS; ++k) // rows y - BLUR_RADIUS, ...
+				src[k] = in + (size_t)std::min(h - 1,
+					std::max(0, y + k - BLUR_RADIUS)) * w;
+			sum_kernel(src, weights, TAPS, 0, w, line + BLUR_RADIUS);
+			for (int k = 0; k < BLUR_RADIUS; ++k) {
+				line[k] = line[BLUR_RADIUS];
+				line[BLUR_RADIUS + w + k] = line[BLUR_RADIUS + w - 1];
+			}
+			for (int k = 0; k < TAPS; ++k) src[k] = line + k; // x - BLUR_RADIUS, ...
+			sum_kernel(src, weights, TAPS, 0, w, out + (size_t)y * w);
+		}
+	};
+	ThreadPool::shared().run(thread_num, blurRows);
+	workspace.gray.swap(workspace.blurred);
+	workspace.gray.bind(gray_img, w, h);
+}
+
+/* The 2 * BLUR_RADIUS + 1 weights of SEPARABLE_BLUR, see blurSeparable */
+void Hough::blurWeights(float* weights) {
+	const int TAPS = 2 * BLUR_RADIUS + 1, ONE = 1 << 16;
+	// impulse far enough from the ends that their boundaries do not matter
+	float coef[8], impulse[2 * TAPS], impulse_line[2 * TAPS];
+	dericheCoefficients(coef);
+	std::fill(impulse, impulse + 2 * TAPS, 0.0f);
+	impulse[TAPS] = 1;
+	dericheLine(impulse, 2 * TAPS, 1, coef, impulse_line);
+	int total = 0;
+	for (int k = 0; k < TAPS; ++k)
+		total += (int)(weights[k] =
+			std::floor(impulse[TAPS - BLUR_RADIUS + k] * ONE + 0.5f));
+	weights[BLUR_RADIUS] += ONE - total;
+	for (int k = 0; k < TAPS; ++k) weights[k] /= ONE;
+}
+
+/* Number of threads of the stages split into blocks of rows */
+int Hough::rowThreadNum(int rows) {
+	int thread_num = options.threads;
+	if (thread_num <= 0) thread_num = std::thread::hardware_concurrency();
+	return std::max(1, std::min(thread_num, rows / MIN_THREAD_ROWS));
+}
+
+/* get intensity gradient magnitude for edge detection, and collect
+*  strong edges with their gradient direction for the later stages */
 void Hough::getGradient() {
+	workspace.gradients.bind(gradients, w, h); // completely written
+	edges.clear();
 	CImg_3x3(I, float);
 	cimg_for3x3(gray_img, x, y, 0, 0, I, float) {
 		// one-dimension filter better than 2D(sobel etc)
-		gradients(x, y) = distance(Inc - Ipc, Icp - Icn);
+		float magnitude = distance(Inc - Ipc, Icp - Icn);
+		gradients(x, y) = magnitude;
+		// consider only strong edges, 
+		// also helps to reduce the number of votes
+		if (magnitude > GRAD_THRESHOLD) {
+			// y axis points down, so the vertical difference is Icn - Icp
+			float direction = atan2(Icn - Icp, Inc - Ipc) * 180 / cimg::PI;
+			edges.push_back(x, y, magnitude,
+				direction < 0 ? direction + 360 : direction);
+		}
 	}
 }
 
-/* Transform points in parameter space to hough space */
+/* rgb2gray, SEPARABLE_BLUR and getGradient fused: the image is read
+*  once, row by row, and only the last rows each stage needs are kept:
+*  2 * BLUR_RADIUS + 1 gray rows, one vertically blurred line and 3
+*  blurred rows, all in L2 cache. Neither gray_img nor gradients is
+*  written, the strong edges go straight to edges. Every row is
+*  computed with the arithmetic of the separate stages, so edges are
+*  exactly the same. Blocks of rows run on the thread pool, each also
+*  computes the rows around it that it needs, and their edges are
+*  joined in row order. */
+void Hough::streamEdges() {
+	const int TAPS = 2 * BLUR_RADIUS + 1;
+	float weights[TAPS];
+	blurWeights(weights);
+	int thread_num = rowThreadNum(h);
+	const int line_size = w + 2 * BLUR_RADIUS;
+	const size_t rows_size = (size_t)(TAPS + 3) * w + line_size;
+	float* rows = workspace.stream_rows.reserve(thread_num * rows_size);
+	if ((int)band_edges.size() < thread_num) band_edges.resize(thread_num);
+	auto streamRows = [&](int t) {
+		float* gray = rows + t * rows_size; // ring of TAPS rows
+		float* blurred = gray + (size_t)TAPS * w; // ring of 3 rows
+		float* line = blurred + 3 * (size_t)w;
+		EdgePoints& band = band_edges[t];
+		band.clear();
+		int first = h * t / thread_num, last = h * (t + 1) / thread_num;
+		int next_blurred = std::max(0, first - 1);
+		int next_gray = std::max(0, next_blurred - BLUR_RADIUS);
+		const float* src[TAPS];
+		for (int y = first; y < last; ++y) {
+			for (; next_blurred <= std::min(h - 1, y + 1); ++next_blurred) {
+				int yb = next_blurred;
+				for (; next_gray <= std::min(h - 1, yb + BLUR_RADIUS); ++next_gray)
+					grayPixels((size_t)next_gray * w, w,
+						gray + (size_t)(next_gray % TAPS) * w);
+				for (int k = 0; k < TAPS; ++k) // rows yb - BLUR_RADIUS, ...
+					src[k] = gray + (size_t)(std::min(h - 1,
+						std::max(0, yb + k - BLUR_RADIUS)) % TAPS) * w;
+				sum_kernel(src, weights, TAPS, 0, w, line + BLUR_RADIUS);
+				for (int k = 0; k < BLUR_RADIUS; ++k) {
+					line[k] = line[BLUR_RADIUS];
+					line[BLUR_RADIUS + w + k] = line[BLUR_RADIUS + w - 1];
+				}
+				for (int k = 0; k < TAPS; ++k) src[k] = line + k;
+				sum_kernel(src, weights, TAPS, 0, w, blurred + (size_t)(yb % 3) * w);
+			}
+			gradientRow(blurred + (size_t)(std::max(0, y - 1) % 3) * w,
+				blurred + (size_t)(y % 3) * w,
+				blurred + (size_t)(std::min(h - 1, y + 1) % 3) * w, y, band);
+		}
+	};
+	ThreadPool::shared().run(thread_num, streamRows);
+	edges.clear();
+	for (int t = 0; t < thread_num; ++t) {
+		const EdgePoints& band = band_edges[t];
+		edges.x.insert(edges.x.end(), band.x.begin(), band.x.end());
+		edges.y.insert(edges.y.end(), band.y.begin(), band.y.end());
+		edges.magnitude.insert(edges.magnitude.end(),
+			band.magnitude.begin(), band.magnitude.end());
+		edges.direction.insert(edges.direction.end(),
+			band.direction.begin(), band.direction.end());
+	}
+}
+
+/* Strong edges of blurred row y like getGradient, from the rows above
+*  and below it, with the same boundaries as cimg_for3x3 */
+void Hough::gradientRow(const float* above, const float* row,
+	const float* below, int y, EdgePoints& out) {
+	for (int x = 0; x < w; ++x) {
+		float Ipc = row[std::max(0, x - 1)], Inc = row[std::min(w - 1, x + 1)],
+			Icp = above[x], Icn = below[x];
+		float magnitude = distance(Inc - Ipc, Icp - Icn);
+		if (magnitude > GRAD_THRESHOLD) {
+			float direction = atan2(Icn - Icp, Inc - Ipc) * 180 / cimg::PI;
+			out.push_back(x, y, magnitude,
+				direction < 0 ? direction + 360 : direction);
+		}
+	}
+}
+
+/* Transform points in parameter space to hough space.
+*  A line gets at most one vote from each edge pixel, so a 16 bit
+*  accumulator can not overflow with fewer than 65536 edge pixels. */
 void Hough::houghTransform() {
-	cimg_forXY(gradients, x, y) {
-		// consider only strong edges, 
-		// also helps to reduce the number of votes
-		if (gradients(x, y) > GRAD_THRESHOLD) {
-			cimg_forX(hough_space, angle) {
-				double theta = 1.0 * angle * cimg::PI / 180.0;
-				int rho = (int)(x*cos(theta) + y*sin(theta));
-				if (rho >= 0 && rho < hough_space.height()) {
-					// By the above calculation, the hough space
-					// is not consistent. (left 180 degree and
-					// right 180 degree should swap)
-					// If not consistent, the points lying in the 
-					// split edge will be considered as two different
-					// parts which is wrong. So I shift hough space
-					// by 180 degree to make it consistent.
-					// Then angle should minus 180 in some following
-					// calculation. 
-					++hough_space((angle + 180) % 360, rho);
+	if (edges.size() <= 0xFFFF) {
+		hough_space32.assign();
+		houghTransform(hough_space16);
+	}
+	else {
+		hough_space16.assign();
+		houghTransform(hough_space32);
+	}
+}
+
+/* Edge pixels are split into bands, one per thread. Each thread votes
+*  into its own accumulator, then the accumulators are summed up.
+*  Accumulators live in the workspace and threads in the shared pool. */
+template<typename T>
+void Hough::houghTransform(CImg<T>& space) {
+	int space_w = angle_num, space_h = rho_rows;
+	if (options.layout == RHO_CONTIGUOUS) std::swap(space_w, space_h);
+	workspace.hough(T()).bind(space, space_w, space_h).fill(0);
+	int thread_num = threadNum();
+	if (thread_num == 1) {
+		voteEdges(space, 0, edges.size());
+		return;
+	}
+	// the first band votes into space directly
+	size_t size = space.size();
+	T* partial = workspace.partial(T()).reserve((thread_num - 1) * size);
+	int edge_num = edges.size();
+	int band = (edge_num + thread_num - 1) / thread_num;
+	auto vote = [&](int i) {
+		CImg<T> band_space;
+		if (i == 0) band_space.assign(space, true);
+		else band_space.assign(partial + (i - 1) * size,
+			space_w, space_h, 1, 1, true).fill(0);
+		voteEdges(band_space, std::min(edge_num, i * band),
+			std::min(edge_num, (i + 1) * band));
+	};
+	ThreadPool::shared().run(thread_num, vote);
+
+	// reduction: each thread sums up one slice of all accumulators
+	size_t slice = (size + thread_num - 1) / thread_num;
+	auto reduce = [&](int i) {
+		addAccumulators(space.data(), partial, thread_num - 1, size,
+			std::min(size, i * slice), std::min(size, (i + 1) * slice));
+	};
+	ThreadPool::shared().run(thread_num, reduce);
+}
+
+/* Number of voting threads. A few edges are not worth more threads. */
+int Hough::threadNum() {
+	int thread_num = options.threads;
+	if (thread_num <= 0) thread_num = std::thread::hardware_concurrency();
+	return std::max(1, std::min(thread_num, edges.size() / MIN_THREAD_EDGES));
+}
+
+/* Vote for edge pixels with index in [first, last) */
+template<typename T>
+void Hough::voteEdges(CImg<T>& space, int first, int last) {
+	const int* xs = edges.x.data();
+	const int* ys = edges.y.data();
+	const float* directions = edges.direction.data();
+	for (int i = first; i < last; ++i) {
+		if (options.voting == GRADIENT_ANGLES)
+			voteAngleWindow(space, xs[i], ys[i],
+			(int)floor(directions[i] + 0.5));
+		else
+			voteAngles(space, xs[i], ys[i], 0, angle_num);
+	}
+}
+
+/* Vote for lines through (x, y) with angle in [first, last).
+*  Angles are the unshifted ones of the accumulator mode. */
+template<typename T>
+void Hough::voteAngles(CImg<T>& space, int x, int y, int first, int last) {
+	int rows[360]; // row of every angle, at most 360 of them
+	rho_kernel(trig->cosData() + first, trig->sinData() + first, x, y,
+		rho_offset, last - first, rows);
+	if (options.accumulator == HALF_RANGE) {
+		// signed rho needs no wrap around: line (theta + 180, rho)
+		// is the same as line (theta, -rho), see houghVotes
+		for (int angle = first; angle < last; ++angle) {
+			int row = rows[angle - first];
+			if (row >= 0 && row < rho_rows)
+				++houghCell(space, angle, row);
+		}
+		return;
+	}
+	for (int angle = first; angle < last; ++angle) {
+		int rho = rows[angle - first];
+		if (rho >= 0 && rho < rho_rows) {
+			// By the above calculation, the hough space
+			// is not consistent. (left 180 degree and
+			// right 180 degree should swap)
+			// If not consistent, the points lying in the 
+			// split edge will be considered as two different
+			// parts which is wrong. So I shift hough space
+			// by 180 degree to make it consistent.
+			// Then angle should minus 180 in some following
+			// calculation. 
+			++houghCell(space, (angle + 180) % 360, rho);
+		}
+	}
+}
+
+/* Vote for angles within angle_window degrees of center (a gradient
+*  direction in degree). The window wraps around the accumulator. */
+template<typename T>
+void Hough::voteAngleWindow(CImg<T>& space, int x, int y, int center) {
+	// in FULL_RANGE mode the normal of the line may point to either
+	// side of the edge, only one of them gives rho >= 0
+	int sides = options.accumulator == FULL_RANGE ? 2 : 1;
+	for (int side = 0; side < sides; ++side, center += 180) {
+		int first = (center - options.angle_window) % angle_num;
+		if (first < 0) first += angle_num;
+		int last = first + 2 * options.angle_window + 1;
+		if (last > angle_num) {
+			voteAngles(space, x, y, first, angle_num);
+			voteAngles(space, x, y, 0, last - angle_num);
+		}
+		else {
+			voteAngles(space, x, y, first, last);
+		}
+	}
+}
+
+/* Levels 1 to level_num of the image pyramid in workspace.pyramid,
+*  level j halving level j - 1 and level 1 the image detected on */
+void Hough::buildPyramid(int level_num) {
+	size_t size = 0;
+	for (int j = 1; j <= level_num; ++j) size += (size_t)3 * (w >> j) * (h >> j);
+	workspace.pyramid.reserve(size); // so pyramidLevel never moves it
+	if (!rgb8_img.is_empty())
+		shrinkImage(rgb8_img.data(), w, h, rgb8_img.spectrum(), 2, pyramidLevel(1));
+	else
+		shrinkImage(rgb_img.data(), w, h, rgb_img.spectrum(), 2, pyramidLevel(1));
+	for (int j = 2; j <= level_num; ++j)
+		shrinkImage(pyramidLevel(j - 1), w >> (j - 1), h >> (j - 1), 3, 2,
+			pyramidLevel(j));
+}
+
+/* 3 planes of 1 / factor of the width and height of src into dst,
+*  every pixel the average of a block of factor x factor pixels (the
+*  last rows or columns that do not fill a block are dropped). The
+*  planes of a gray image are repeated. Blocks of rows run on the
+*  thread pool. */
+template<typename T>
+void Hough::shrinkImage(const T* src, int width, int height, int spectrum,
+	int factor, float* dst) {
+	const int small_w = width / factor, small_h = height / factor;
+	const float scale = 1.0f / (factor * factor);
+	int thread_num = rowThreadNum(small_h);
+	auto shrinkRows = [&](int t) {
+		for (int c = 0; c < 3; ++c) {
+			const T* plane = src + (size_t)std::min(c, spectrum - 1) * width * height;
+			float* out = dst + (size_t)c * small_w * small_h;
+			for (int y = small_h * t / thread_num; y < small_h * (t + 1) / thread_num; ++y) {
+				float* row = out + (size_t)y * small_w;
+				std::fill(row, row + small_w, 0.0f);
+				for (int dy = 0; dy < factor; ++dy) {
+					const T* in = plane + (size_t)(y * factor + dy) * width;
+					for (int x = 0; x < small_w; ++x)
+						for (int dx = 0; dx < factor; ++dx)
+							row[x] += in[x * factor + dx];
 				}
+				for (int x = 0; x < small_w; ++x) row[x] *= scale;
 			}
 		}
+	};
+	ThreadPool::shared().run(thread_num, shrinkRows);
+}
+
+/* Level j of the image pyramid, see buildPyramid */
+float* Hough::pyramidLevel(int j) {
+	size_t offset = 0;
+	for (int i = 1; i < j; ++i) offset += (size_t)3 * (w >> i) * (h >> i);
+	return workspace.pyramid.reserve(offset) + offset;
+}
+
+/* Run level (a detector kept for it) up to the edge pixels of
+*  level j of the image pyramid, on a view of the level */
+void Hough::initLevel(Hough& level, int j) {
+	level.options = options;
+	level.options.pyramid_levels = 1;
+	level.rgb8_img.assign();
+	level.source_img.assign();
+	level.rgb_img.assign(pyramidLevel(j), w >> j, h >> j, 1, 3, true);
+	level.initBuffers();
+	// not scaled down by the level: the noisier coarse hough space
+	// needs clusters as wide (in pixels) as the image detected on
+	level.pixel_scale = pixel_scale;
+	level.findEdges();
+}
+
+/* Whether rgb2gray, blur and getGradient run as streamEdges */
+bool Hough::fused() {
+	return options.fused && options.blur == SEPARABLE_BLUR && !verbose;
+}
+
+/* Coarse-to-fine search of the four edges. The whole hough chain runs
+*  on the coarsest level of an image pyramid (each level half of the
+*  size of the next one). Then every level doubles rho of the edges
+*  and refines them by voting only near them (refineHoughEdges). The
+*  levels are built by halving the level before, all of them are run
+*  by level_detector, and the full resolution image only goes through
+*  findEdges for the last refinement. */
+DetectionStatus Hough::getPyramidHoughEdges() {
+	int level_num = options.pyramid_levels - 1; // of the coarsest level
+	// too small coarse levels lose the edges
+	while (level_num > 0 && (std::min(w, h) >> level_num) < MIN_PYRAMID_SIZE)
+		--level_num;
+	if (level_num == 0) { // no smaller level, search on the image itself
+		findEdges();
+		houghTransform();
+		return getHoughEdges();
+	}
+	buildPyramid(level_num);
+	if (!level_detector) level_detector.reset(new Hough());
+	Hough& level = *level_detector;
+	initLevel(level, level_num);
+	level.houghTransform();
+	if (verbose) level.getHoughSpaceImg().display();// .save("dataset1/hough_space.bmp");
+	DetectionStatus coarse_status = level.getHoughEdges();
+	if (coarse_status != DETECTION_OK) return coarse_status;
+	hough_edges = level.hough_edges;
+	for (int j = level_num - 1; j >= 1; --j) {
+		initLevel(level, j);
+		refineHoughEdges(level.edges);
+	}
+	findEdges();
+	refineHoughEdges(edges);
+	return DETECTION_OK;
+}
+
+/* Refine hough_edges found on the previous (half size) pyramid level
+*  with edge pixels of the current level. Each edge is searched within
+*  REFINE_ANGLE degrees of its angle. A line turned about a point far
+*  from the paper sheet moves a lot at the sheet, so every trial angle
+*  gets its own window of refine_rho (REFINE_RHO in pixels of rgb_img)
+*  around the rho of the line through
+*  the middle of the edge pixels near the doubled coarse line. Only
+*  pixels that can fall into one of these windows vote. */
+void Hough::refineHoughEdges(const EdgePoints& level_edges) {
+	const int refine_rho = scaled(REFINE_RHO);
+	const int angles = 2 * REFINE_ANGLE + 1, rhos = 2 * refine_rho + 1;
+	int* votes = workspace.refine_votes.reserve(angles * rhos);
+	// a pixel at distance u along the line from the middle and v across
+	// it is v * cos(da) + u * sin(da) from the middle on the line turned
+	// by da, which has to be within refine_rho (+ 1.5 for the rounding)
+	const double reach = (refine_rho + 2) / trig->cosAt(REFINE_ANGLE),
+		slope = trig->sinAt(REFINE_ANGLE) / trig->cosAt(REFINE_ANGLE);
+	for (size_t i = 0; i < hough_edges.size(); ++i) {
+		int center_angle = hough_edges[i].angle;
+		int center_rho = 2 * hough_edges[i].rho;
+		// hough_edges use the shifted angle, see houghTransform
+		int shifted = (center_angle + 180) % 360;
+		float cos_a = trig->cosAt(shifted), sin_a = trig->sinAt(shifted);
+		// middle of the edge pixels near the coarse line, or the point
+		// of the line closest to the origin if there are none
+		double xm = center_rho * cos_a, ym = center_rho * sin_a;
+		double x_sum = 0, y_sum = 0;
+		int near_num = 0;
+		for (int j = 0; j < level_edges.size(); ++j) {
+			int x = level_edges.x[j], y = level_edges.y[j];
+			if (abs((int)(x*cos_a + y*sin_a) - center_rho) <= refine_rho) {
+				x_sum += x;
+				y_sum += y;
+				++near_num;
+			}
+		}
+		if (near_num > 0) {
+			xm = x_sum / near_num;
+			ym = y_sum / near_num;
+		}
+		int window[2 * REFINE_ANGLE + 1]; // rho in the middle of every window
+		for (int da = 0; da < angles; ++da) {
+			int angle = center_angle + da - REFINE_ANGLE + 180;
+			angle = (angle % 360 + 360) % 360;
+			window[da] = (int)floor(xm*trig->cosAt(angle) + ym*trig->sinAt(angle) + 0.5);
+		}
+		std::fill(votes, votes + angles * rhos, 0); // rho-major like CImg
+		for (int j = 0; j < level_edges.size(); ++j) {
+			int x = level_edges.x[j], y = level_edges.y[j];
+			double u = (y - ym) * cos_a - (x - xm) * sin_a,
+				v = (x - xm) * cos_a + (y - ym) * sin_a;
+			if (std::abs(v) > reach + std::abs(u) * slope) continue;
+			for (int da = 0; da < angles; ++da) {
+				int angle = center_angle + da - REFINE_ANGLE + 180;
+				angle = (angle % 360 + 360) % 360;
+				int dr = (int)(x*trig->cosAt(angle) + y*trig->sinAt(angle))
+					- window[da] + refine_rho;
+				if (dr >= 0 && dr < rhos) ++votes[dr * angles + da];
+			}
+		}
+		int max_val = 0;
+		for (int dr = 0; dr < rhos; ++dr) for (int da = 0; da < angles; ++da) {
+			int rho = window[da] + dr - refine_rho;
+			// rho <= 0 is filtered out like in getHoughEdges
+			if (rho > 0 && votes[dr * angles + da] > max_val) {
+				max_val = votes[dr * angles + da];
+				int angle = center_angle + da - REFINE_ANGLE;
+				hough_edges[i] = HoughEdge((angle % 360 + 360) % 360,
+					rho, max_val);
+			}
+		}
+		if (max_val == 0) hough_edges[i].rho = center_rho; // no vote
 	}
 }
 
@@ -112,24 +1128,36 @@ void Hough::houghTransform() {
 *  => Get four clusters with the highest values and
 *  select the brighest point from each of them.
 */
-void Hough::getHoughEdges() {
-	int maxVal = hough_space.max();
+DetectionStatus Hough::getHoughEdges() {
+	if (!hough_space16.is_empty()) findHoughEdges(hough_space16);
+	else findHoughEdges(hough_space32);
+	return filterHoughEdges();
+}
+
+/* Keep the brightest point of every cluster of strong votes */
+template<typename T>
+void Hough::findHoughEdges(CImg<T>& space) {
+	int maxVal = space.max();
 	int threshold = floor(maxVal / Q);
-	std::cout << maxVal << " " << threshold << std::endl;
-	cimg_forXY(hough_space, angle, rho) {
-		int val = hough_space(angle, rho);
+	if (verbose) std::cout << maxVal << " " << threshold << std::endl;
+	const int scope_rho = scaled(SCOPE_RHO);
+	// scan in the order of the 360 degree hough space in any mode
+	for (int rho = 0; rho < rho_num; ++rho) for (int angle = 0; angle < 360; ++angle) {
+		T* votes = houghVotes(space, angle, rho);
+		if (votes == NULL) continue; // no vote at all
+		int val = *votes;
 		if (val < threshold || rho == 0) {
 			// filter out rho == 0 (intercept == 0)
-			hough_space(angle, rho) = 0;
+			*votes = 0;
 		}
 		else {
 			HoughEdge hough_edge(angle, rho, val);
 			bool is_new_corner = true;
-			for (int i = 0; i < hough_edges.size(); ++i) {
+			for (size_t i = 0; i < hough_edges.size(); ++i) {
 				//if (distance(hough_edges[i].angle - angle,
 				//	hough_edges[i].rho - rho) < 20) {
 				if (abs(hough_edges[i].angle - angle) < SCOPE_ANGLE
-					&& abs(hough_edges[i].rho - rho) < SCOPE_RHO) {
+					&& abs(hough_edges[i].rho - rho) < scope_rho) {
 					is_new_corner = false;
 					// compare with the other value in this cluster
 					if (val > hough_edges[i].val) {
@@ -141,6 +1169,10 @@ void Hough::getHoughEdges() {
 			if (is_new_corner) hough_edges.push_back(hough_edge);
 		}
 	}
+}
+
+/* Filter out edges not belonging to the paper sheet */
+DetectionStatus Hough::filterHoughEdges() {
 	if (hough_edges.size() > 4) { // filter out some (maybe not 4) strong edges
 		sort(hough_edges.begin(), hough_edges.end(), cmp_edges_val);
 		// Some edges like tables edges can be stronger than paper edges.
@@ -192,22 +1224,17 @@ void Hough::getHoughEdges() {
 					hough_edges.erase(hough_edges.begin() + 2);
 			}
 		}
-		if (hough_edges.size() != 4) {
-			std::cout << "ERROR: Bug in function void Hough::getHoughEdges()!\
-            Please check the ifelse statement to filter out four hough_edges." << std::endl;
-			exit(-2);
-		}
+		if (hough_edges.size() != 4) return EDGE_FILTER_FAILED;
 	}
 	else if (hough_edges.size() < 4) {
-		std::cout << "ERROR: Please set parameter Q larger in file \
-			'hough_transform.h' to filter out four edges!" << std::endl;
-		exit(-1);
+		return TOO_FEW_EDGES;
 	}
+	return DETECTION_OK;
 }
 
 /* Transform the points in hough space to lines in parameter space */
 void Hough::getLines() {
-	for (int i = 0; i < hough_edges.size(); ++i) {
+	for (size_t i = 0; i < hough_edges.size(); ++i) {
 		if ((hough_edges[i].angle - 180) == 0) { // perpendicular to x axis
 			lines.push_back(Line(0, 0, hough_edges[i].rho));
 			continue;
@@ -222,12 +1249,13 @@ void Hough::getLines() {
 /* Get four corners of paper sheet by calculate
 *  the intersections of four lines. */
 void Hough::getCorners() {
+	const int d = scaled(D);
 	int x, y;
 	double m0, m1, b0, b1;
-	for (int i = 0; i < lines.size(); ++i) { // for each line i
-		for (int j = 0; j < lines.size(); ++j) { // intersect with line j
+	for (size_t i = 0; i < lines.size(); ++i) { // for each line i
+		for (size_t j = 0; j < lines.size(); ++j) { // intersect with line j
 			if (j == i || lines[i].end_point_num >= 2 // at most two end points
-				|| lines[i].dist_o > 0 && lines[j].dist_o > 0)  // both vertical
+				|| (lines[i].dist_o > 0 && lines[j].dist_o > 0))  // both vertical
 				continue;
 			m0 = lines[i].m;
 			b0 = lines[i].b;
@@ -252,7 +1280,7 @@ void Hough::getCorners() {
 			*  due to part of paper sheet image or not well aligned lines.
 			*  Setting them to the border of image can solve this
 			*  problem to some extent. */
-			if (x >= 0 - D && x < w + D && y >= 0 - D && y < h + D) {
+			if (x >= 0 - d && x < w + d && y >= 0 - d && y < h + d) {
 				if (x < 0) x = 0; else if (x >= w) x = w - 1;
 				if (y < 0) y = 0; else if (y >= h) y = h - 1;
 				if (lines[i].end_point_num == 0) { // first end point
@@ -270,39 +1298,60 @@ void Hough::getCorners() {
 	}
 }
 
-void Hough::orderCorners() {
+/* Confidence of the detection: the fraction of each edge segment
+*  supported by votes, taking the weakest of the four edges. */
+void Hough::getConfidence() {
+	confidence = lines.empty() ? 0 : 1;
+	for (size_t i = 0; i < lines.size() && i < hough_edges.size(); ++i) {
+		float length = lines[i].end_point_num < 2 ? 0 : distance(
+			lines[i].x1 - lines[i].x0, lines[i].y1 - lines[i].y0);
+		float support = length < 1 ? 0 : hough_edges[i].val / length;
+		confidence = std::min(confidence, std::min(1.0f, support));
+	}
+}
+
+DetectionStatus Hough::orderCorners() {
 	// Usually, if paper sheet is placed vertically(do not need strictly)
 	// corners are ordered in top-left, top-right, bottom-left, bottom-right
 	//  position by sorting (compare by the distance from original point)
 	// Note: original point is in the top-left of image
 	sort(corners.begin(), corners.end(), cmp_corners);
-	for (int i = 0; i < corners.size(); i += 2)
+	for (size_t i = 0; i < corners.size(); i += 2)
 		ordered_corners.push_back(Point(corners[i].x, corners[i].y));
 	
-	if (ordered_corners.size() < 4) {
-		std::cout << "ERROR: Can not detect four ordered_corners in function \
-        void Hough::orderCorners(). Please try to adjust parameters." << std::endl;
-		exit(-3);
-	}
+	if (ordered_corners.size() < 4) return TOO_FEW_CORNERS;
+	// every edge ends at two corners and no corners coincide, else the
+	// edges (e.g. two on one side of the sheet) are no quadrilateral
+	for (size_t i = 0; i < lines.size(); ++i)
+		if (lines[i].end_point_num < 2) return DEGENERATE_CORNERS;
+	for (size_t i = 0; i < ordered_corners.size(); ++i)
+		for (size_t j = i + 1; j < ordered_corners.size(); ++j)
+			if (distance(ordered_corners[i].x - ordered_corners[j].x,
+				ordered_corners[i].y - ordered_corners[j].y)
+				< scaled(MIN_CORNER_DISTANCE))
+				return DEGENERATE_CORNERS;
+	// the fine tuning below is in pixels of the full resolution image
+	for (size_t i = 0; i < ordered_corners.size(); ++i)
+		ordered_corners[i] = toSource(ordered_corners[i]);
 	x1 = ordered_corners[0].x, y1 = ordered_corners[0].y; // top-left
 	x2 = ordered_corners[1].x, y2 = ordered_corners[1].y; // top-right
 	x3 = ordered_corners[2].x, y3 = ordered_corners[2].y; // bottom-left
 	x4 = ordered_corners[3].x, y4 = ordered_corners[3].y; // bottom-right
 	// fine tuning the corners to white paper sheet if not
 	const int SHIFT = 3;
-	if (rgb_img(x1, y1) < 125) {
+	if (red(x1, y1) < 125) {
 		x1 += SHIFT;
 		y1 += SHIFT;
 	}
-	if (rgb_img(x2, y2) < 125) {
+	if (red(x2, y2) < 125) {
 		x2 -= SHIFT;
 		y2 += SHIFT;
 	}
-	if (rgb_img(x3, y3) < 125) {
+	if (red(x3, y3) < 125) {
 		x3 += SHIFT;
 		y3 -= SHIFT;
 	}
-	if (rgb_img(x4, y4) < 125) {
+	if (red(x4, y4) < 125) {
 		x4 -= SHIFT;
 		y4 -= SHIFT;
 	}
@@ -325,15 +1374,24 @@ void Hough::orderCorners() {
 	ordered_corners[1].x = x2, ordered_corners[1].y = y2;
 	ordered_corners[2].x = x3, ordered_corners[2].y = y3;
 	ordered_corners[3].x = x4, ordered_corners[3].y = y4;
+	return DETECTION_OK;
+}
+
+/* Red channel of the full resolution image */
+float Hough::red(int x, int y) const {
+	if (!source_img.is_empty()) return source_img(x, y);
+	return rgb8_img.is_empty() ? rgb_img(x, y) : rgb8_img(x, y);
 }
 
 /* draw and print corners and lines in original image */
 void Hough::displayCornersAndLines() {
-	marked_img = getRGBImg();
+	const CImg<float>& img = getRGBImg();
+	workspace.marked.bind(marked_img, img.width(), img.height(), 1, img.spectrum());
+	std::copy(img.data(), img.data() + img.size(), marked_img.data());
 	// draw
 	const unsigned char color_red[] = { 255,0,0 };
 	const unsigned char color_yellow[] = { 255,255,0 };
-	for (int i = 0; i < lines.size(); ++i) {
+	for (size_t i = 0; i < lines.size(); ++i) {
 		marked_img.draw_line(lines[i].x0, lines[i].y0,
 		lines[i].x1, lines[i].y1, color_red);
 		marked_img.draw_circle(lines[i].x0, lines[i].y0, 5, color_yellow);
@@ -10,8 +10,14 @@
 #ifndef _Hough_
 #define _Hough_
 #include "CImg.h"
+#include "Simd.h"
+#include "TrigTable.h"
+#include "ThreadPool.h"
+#include "Workspace.h"
 #include<iostream>
+#include<memory>
 #include<vector>
+#include<stdint.h>
 using namespace cimg_library;
 struct HoughEdge {
 	int angle, rho, val;
@@ -29,54 +35,234 @@ struct Line {
 		: m(_m), b(_b), dist_o(_dist_o), x0(_x0), x1(_x1), y0(_y0), y1(_y1),
 	    end_point_num(_end_point_num) {}
 };
+/* Parameterisation of the hough accumulator.
+*  FULL_RANGE: 360 angles and rho >= 0, every line shows up twice.
+*  HALF_RANGE: 180 angles and signed rho, every line shows up once,
+*              so voting does half of the work. */
+enum AccumulatorMode { FULL_RANGE, HALF_RANGE };
+/* Angles every strong edge pixel votes for.
+*  ALL_ANGLES: every angle of the accumulator.
+*  GRADIENT_ANGLES: only angles within angle_window degrees of the
+*                   gradient direction (the normal of the edge). */
+enum VotingMode { ALL_ANGLES, GRADIENT_ANGLES };
+/* Memory layout of the hough accumulator.
+*  ANGLE_CONTIGUOUS: one row per rho, angles next to each other.
+*  RHO_CONTIGUOUS: one row per angle, rho next to each other. Votes of
+*                  neighbouring edge pixels for one angle hit nearby
+*                  rho, so they share cache lines. */
+enum AccumulatorLayout { ANGLE_CONTIGUOUS, RHO_CONTIGUOUS };
+/* Blur of the gray image before the gradient.
+*  DERICHE_BLUR: exactly CImg's blur, a recursive filter along every
+*                row and column, one after another.
+*  SEPARABLE_BLUR: the impulse response of the same filter as integer
+*                  weights, each output row in one pass over the input
+*                  rows it needs, SIMD and multithreaded. Differs from
+*                  DERICHE_BLUR by well below one gray level. */
+enum BlurMode { DERICHE_BLUR, SEPARABLE_BLUR };
+struct HoughOptions {
+	AccumulatorMode accumulator;
+	AccumulatorLayout layout;
+	VotingMode voting;
+	int angle_window; // half width of the voting window in degree, at most 89
+	int threads; // voting threads, 0 for all hardware threads
+	bool simd; // use AVX2/NEON kernels if the CPU supports them
+	BlurMode blur;
+	// with SEPARABLE_BLUR, compute gray, blur and gradient in one
+	// stream over the rows without full size images, see streamEdges.
+	// Off by default: it runs at 0.9 to 1.1 times the speed of the
+	// separate stages on 0.2 megapixel images. Turn it on to save the 12
+	// bytes per pixel of those images, for large images or small caches.
+	bool fused;
+	// > 1 to search edges coarse-to-fine on an image pyramid of this
+	// many levels, each half of the size of the next one
+	int pyramid_levels;
+	// < 1 to detect on a proxy downscaled by this factor, rounded to
+	// 1 / k for a whole k (see initSource); corners are mapped back to
+	// the full resolution image used for warping
+	float detection_scale;
+	HoughOptions() : accumulator(HALF_RANGE), layout(RHO_CONTIGUOUS),
+		voting(ALL_ANGLES), angle_window(5), threads(0), simd(true),
+		blur(SEPARABLE_BLUR), fused(false), pyramid_levels(1),
+		detection_scale(1) {}
+};
+/* Strong edge pixels (gradient magnitude > GRAD_THRESHOLD) in
+*  row-major order, stored as structure of arrays so that every stage
+*  only touches the fields it needs. */
+struct EdgePoints {
+	std::vector<int> x, y;
+	std::vector<float> magnitude;
+	std::vector<float> direction; // gradient direction in degree, [0, 360)
+	int size() const { return (int)x.size(); }
+	void clear() {
+		x.clear(); y.clear(); magnitude.clear(); direction.clear();
+	}
+	void push_back(int _x, int _y, float _magnitude, float _direction) {
+		x.push_back(_x); y.push_back(_y);
+		magnitude.push_back(_magnitude); direction.push_back(_direction);
+	}
+};
 struct Point {
 	int x, y;
 	Point(int _x, int _y) : x(_x), y(_y) {}
 };
+/* Result of a detection. The negative values are the exit codes
+*  the demo used to stop with, see main.cpp. */
+enum DetectionStatus {
+	DETECTION_OK = 0,
+	TOO_FEW_EDGES = -1, // fewer than four clusters in hough space
+	EDGE_FILTER_FAILED = -2, // could not pick four edges out of five
+	TOO_FEW_CORNERS = -3, // fewer than four corners inside the image
+	DEGENERATE_CORNERS = -4 // the four edges do not form a quadrilateral
+};
+const char* detectionStatusMessage(DetectionStatus status);
+/* Time of every detection stage in milliseconds */
+struct StageTimings {
+	double init; // copy of the input image and downscaling to the proxy
+	double gray, blur, gradient, hough, edges, corners;
+	double total; // of all stages, init included
+	StageTimings() : init(0), gray(0), blur(0), gradient(0), hough(0),
+		edges(0), corners(0), total(0) {}
+};
 class Hough {
 private:
 	/* adjustable parameters */
 	// most of the time, you just need to modify GRAD_THRESHOLD
-	// and Q according to the number of hough_edges
+	// and Q according to the number of hough_edges.
+	// Distances are in pixels of the full resolution image, see scaled
 	const float GRAD_THRESHOLD = 20;
 	const int Q = 3; // the denominator parameter used to get
 	                 // threshold in getHoughEdges; aims to filter
 	                 // out more than 3 edges
 	const float BLUR_SIGMA = 2;
+	// taps on each side of the SEPARABLE_BLUR kernel: 6 * BLUR_SIGMA,
+	// where the blur weights have fallen below 1/10000 of the center one
+	static const int BLUR_RADIUS = 12;
+	const int MIN_THREAD_ROWS = 32; // fewest rows a blur or stream thread gets
 	// since angle and rho are in different scale, use different scope
 	const int SCOPE_ANGLE = 20; // scope of clusters in hough space
 	const int SCOPE_RHO = 100; // scope of clusters in hough space
 	const int D = 20; // intersects can be out of image in distance D
+	const int MIN_CORNER_DISTANCE = 20; // closer corners are degenerate
+	const int MIN_THREAD_EDGES = 1024; // fewest edge pixels a voting thread gets
+	// search window of an edge on the next pyramid level
+	static const int REFINE_ANGLE = 6;
+	const int REFINE_RHO = 12;
+	const int MIN_PYRAMID_SIZE = 200; // smaller side of the coarsest level
+	const int MIN_PROXY_SIZE = 200; // smaller side of the proxy
 	
 	
 	float x1, y1, x2, y2, x3, y3, x4, y4; // source corners
 
 	int w, h; // width and height of rgb image
+	int source_factor; // source_img is this many times larger than rgb_img
+	float pixel_scale; // pixels of rgb_img per full resolution pixel
+	HoughOptions options;
+	bool verbose; // display intermediate results and print progress
+	float confidence; // see getConfidence
+	DetectionStatus status;
+	StageTimings timings;
+	// detector of the coarser pyramid levels, see getPyramidHoughEdges
+	std::unique_ptr<Hough> level_detector;
+	const TrigTable* trig;
+	// rows of n angles for pixel (x, y), see rhoRowsScalar in Hough.cpp
+	void (*rho_kernel)(const double* cos_t, const double* sin_t,
+		int x, int y, int offset, int n, int* rows);
+	// sum of weighted rows, see weightedSumScalar in Hough.cpp
+	void (*sum_kernel)(const float* const* src, const float* weights,
+		int taps, int first, int n, float* out);
+	// gray values of n 8-bit pixels, see grayRowScalar in Hough.cpp
+	void (*gray_kernel)(const unsigned char* r, const unsigned char* g,
+		const unsigned char* b, size_t n, float* gray);
+	int angle_num; // width of hough space
+	int rho_num; // number of non-negative rho, i.e. length of diagonal
+	int rho_offset; // row of rho == 0 in hough_space
+	int rho_rows; // number of rho stored in hough_space
+	int angle_stride, row_stride; // distance between cells, see layout
+	Workspace workspace; // memory of the images below, reused by every image
 	CImg<float> gradients;
-	CImg<float> hough_space;
-	CImg<float> rgb_img;
+	// hough accumulator, only one of them is used (see houghTransform)
+	CImg<uint16_t> hough_space16;
+	CImg<uint32_t> hough_space32;
+	CImg<float> rgb_img; // image to detect on
+	// view of an 8-bit image detected on instead of rgb_img, see init
+	CImg<unsigned char> rgb8_img;
+	CImg<float> source_img; // full resolution image if rgb_img is a proxy
 	CImg<float> marked_img; // with paper sheet corners and edges mark
 	CImg<float> gray_img;
+	EdgePoints edges; // strong edge pixels found by getGradient
+	std::vector<EdgePoints> band_edges; // of each thread of streamEdges
 	std::vector<HoughEdge> hough_edges; // four edges in hough space
 	std::vector<Line> lines; // four edges in parameter space
 	std::vector<Point> corners; // duplicate four corners in normal space
 	std::vector<Point> ordered_corners; // four corners in normal space
 	// in the order of top-left, top-right, bottom-left, bottom-right
 
+	Hough() : verbose(false) {} // see init() and detect()
+	void init(const char* filePath);
+	void init(const CImg<float>& img);
+	void init(const CImg<unsigned char>& img);
+	void initSource();
+	DetectionStatus detect(bool _verbose);
+	void initBuffers();
+	void findEdges();
+	void buildPyramid(int level_num);
+	template<typename T> void shrinkImage(const T* src, int width, int height,
+		int spectrum, int factor, float* dst);
+	float* pyramidLevel(int j);
+	void initLevel(Hough& level, int j);
+	int scaled(int pixels) const;
 	float distance(float diff_x, float diff_y);
+	template<typename T> T& houghCell(CImg<T>& space, int angle, int row);
+	template<typename T> T* houghVotes(CImg<T>& space, int angle, int rho);
 	void rgb2gray();
+	void grayPixels(size_t first, size_t n, float* gray);
+	void blur();
+	void dericheCoefficients(float* coef);
+	void blurSeparable();
+	void blurWeights(float* weights);
+	int rowThreadNum(int rows);
 	void getGradient();
+	bool fused();
+	void streamEdges();
+	void gradientRow(const float* above, const float* row,
+		const float* below, int y, EdgePoints& out);
 	void houghTransform();
-	void getHoughEdges();
+	template<typename T> void houghTransform(CImg<T>& space);
+	int threadNum();
+	template<typename T>
+	void voteEdges(CImg<T>& space, int first, int last);
+	template<typename T>
+	void voteAngles(CImg<T>& space, int x, int y, int first, int last);
+	template<typename T>
+	void voteAngleWindow(CImg<T>& space, int x, int y, int center);
+	DetectionStatus getHoughEdges();
+	template<typename T> void findHoughEdges(CImg<T>& space);
+	DetectionStatus filterHoughEdges();
+	DetectionStatus getPyramidHoughEdges();
+	void refineHoughEdges(const EdgePoints& level_edges);
 	void getLines();
 	void getCorners();
-	void orderCorners();
+	void getConfidence();
+	float red(int x, int y) const;
+	DetectionStatus orderCorners();
+	void mapToSource();
+	Point toSource(const Point& p) const;
 	void displayCornersAndLines();
+	friend class Benchmark;
+	friend class DocumentDetector;
 public:
-	Hough(char * filePath);
-	CImg<float> getRGBImg() { return rgb_img; }
-	CImg<float> getMarkedImg() { return marked_img; }
-	std::vector<Point> getOrderedCorners() { return ordered_corners;}
+	Hough(char * filePath, HoughOptions _options = HoughOptions());
+	// the getters return references to the detector's own data,
+	// valid until the next detection (or the end of the detector)
+	// image the corners refer to, empty if it was an 8-bit image
+	const CImg<float>& getRGBImg() const {
+		return source_img.is_empty() ? rgb_img : source_img;
+	}
+	const CImg<float>& getMarkedImg() const { return marked_img; }
+	CImg<float> getHoughSpaceImg(); // a converted copy, for display only
+	DetectionStatus getStatus() const { return status; }
+	const std::vector<Point>& getOrderedCorners() const { return ordered_corners; }
+	const EdgePoints& getEdgePoints() const { return edges; }
 };
 
 
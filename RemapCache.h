@@ -0,0 +1,116 @@
+/*
+#  File        : RemapCache.h
+#  Description : Remap tables of Warping reused between crops
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#pragma once
+#ifndef _RemapCache_
+#define _RemapCache_
+#include<cstdlib>
+#include<vector>
+
+/* Where the pixels of a crop are sampled, one element per destination
+*  pixel in row-major order. index: the source pixel (i, j) at
+*  i + j * source width, or -1 outside of the source. fraction: the
+*  bilinear fractions x - i (low byte) and y - j (high byte) in 1/256,
+*  truncated like the 8-bit warp does. 6 bytes per pixel. */
+struct RemapTable {
+	int* index;
+	unsigned short* fraction;
+	RemapTable() : index(NULL), fraction(NULL) {}
+};
+
+/* What a remap table depends on: the source corners (x and y of
+*  each), the source size and the crop size */
+struct RemapKey {
+	int corners[8];
+	int src_w, src_h, width, height;
+	/* Same sizes and no corner coordinate more than tolerance away */
+	bool matches(const RemapKey& key, int tolerance) const {
+		for (int i = 0; i < 8; ++i)
+			if (abs(corners[i] - key.corners[i]) > tolerance) return false;
+		return src_w == key.src_w && src_h == key.src_h &&
+			width == key.width && height == key.height;
+	}
+};
+
+/* Remap tables of the last crops, for a camera that sees the paper
+*  sheet at (almost) the same place every time. A crop whose key is
+*  in the cache skips the homography and only gathers the source
+*  pixels listed in the table. With a tolerance of 0 only the same
+*  corners hit: the 8-bit crop is exactly the one without cache, the
+*  float crop is sampled at positions truncated to 1/256 pixel and
+*  differs by less than two grey levels from the one without; with a
+*  tolerance of t pixels corners that moved by up to t pixels in x and
+*  in y hit too and reuse the table of the earlier corners (a fixed
+*  grid of cells would miss whenever a corner crosses a cell border).
+*  The least recently used table is replaced when all capacity tables
+*  are taken, its memory is kept. A table of an A4 crop at 300 dpi
+*  takes 52 MB. A miss builds the table (with AVX2 if available) and
+*  then gathers the crop from it: replacing a table took 0.8 to 1.0
+*  times a warp without cache on the benchmark (Benchmark::warpCache),
+*  a miss that first allocates the table 1.05 to 1.3 times. A cache
+*  must not be used by two warpings at the same time. hits() and
+*  misses() count the lookups. */
+class RemapCache {
+private:
+	struct Table {
+		RemapKey key;
+		std::vector<int> index;
+		std::vector<unsigned short> fraction;
+		unsigned long last_use;
+	};
+	std::vector<Table> tables;
+	int capacity, tolerance;
+	unsigned long use; // clock of last_use
+	long hit_num, miss_num;
+public:
+	RemapCache(int _capacity = 4, int _tolerance = 0) : capacity(_capacity),
+		tolerance(_tolerance), use(0), hit_num(0), miss_num(0) {}
+	/* Table of key, with NULL pointers (and a miss) if there is none */
+	RemapTable find(const RemapKey& key) {
+		RemapTable table;
+		for (size_t i = 0; i < tables.size(); ++i)
+			if (tables[i].key.matches(key, tolerance)) {
+				tables[i].last_use = ++use;
+				++hit_num;
+				table.index = tables[i].index.data();
+				table.fraction = tables[i].fraction.data();
+				return table;
+			}
+		++miss_num;
+		return table;
+	}
+	/* New table of n pixels for key, to be filled by the caller */
+	RemapTable insert(const RemapKey& key, size_t n) {
+		Table* entry;
+		if ((int)tables.size() < capacity || tables.empty()) {
+			tables.push_back(Table());
+			entry = &tables.back();
+		}
+		else {
+			entry = &tables[0];
+			for (size_t i = 1; i < tables.size(); ++i)
+				if (tables[i].last_use < entry->last_use) entry = &tables[i];
+		}
+		entry->key = key;
+		entry->last_use = ++use;
+		entry->index.resize(n);
+		entry->fraction.resize(n);
+		RemapTable table;
+		table.index = entry->index.data();
+		table.fraction = entry->fraction.data();
+		return table;
+	}
+	long hits() const { return hit_num; }
+	long misses() const { return miss_num; }
+	void clear() {
+		tables.clear();
+		hit_num = miss_num = 0;
+	}
+};
+
+#endif
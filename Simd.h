@@ -0,0 +1,80 @@
+/*
+#  File        : Simd.h
+#  Description : SIMD instruction sets and runtime CPU dispatch
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#pragma once
+#ifndef _Simd_
+#define _Simd_
+
+// USE_X86_SIMD: AVX2 kernels are compiled and selected at runtime
+// USE_SSE2_SIMD: SSE2 kernels are compiled (always available on x86-64)
+// USE_NEON_SIMD: NEON kernels are compiled (always available on ARM64)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define USE_X86_SIMD
+#include<immintrin.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2_SIMD
+#endif
+#ifdef _MSC_VER
+#include<intrin.h>
+#define SIMD_TARGET_AVX2 // MSVC accepts AVX2 intrinsics without flags
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define USE_NEON_SIMD
+#include<arm_neon.h>
+#endif
+
+// SIMD_NO_FMA_BEGIN and SIMD_NO_FMA_END enclose the kernels whose scalar
+// and SIMD versions must round every product alike: no multiply and add
+// between them is fused into one FMA. gcc fuses by default (-march=haswell,
+// ARM64) and clang within an expression. MSVC does not fuse under its
+// default /fp:precise since Visual Studio 2022.
+#if defined(__clang__)
+#define SIMD_NO_FMA_BEGIN _Pragma("float_control(push)") \
+	_Pragma("clang fp contract(off)")
+#define SIMD_NO_FMA_END _Pragma("float_control(pop)")
+#elif defined(__GNUC__)
+#define SIMD_NO_FMA_BEGIN _Pragma("GCC push_options") \
+	_Pragma("GCC optimize(\"fp-contract=off\")")
+#define SIMD_NO_FMA_END _Pragma("GCC pop_options")
+#else
+#define SIMD_NO_FMA_BEGIN
+#define SIMD_NO_FMA_END
+#endif
+
+enum SimdLevel { SIMD_SCALAR, SIMD_AVX2, SIMD_NEON };
+
+/* Best instruction set supported by both the build and the CPU */
+inline SimdLevel simdLevel() {
+#if defined(USE_X86_SIMD) && defined(_MSC_VER)
+	static const SimdLevel level = [] {
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return SIMD_SCALAR;
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		// the OS must save the upper halves of the ymm registers
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return SIMD_SCALAR;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) ? SIMD_AVX2 : SIMD_SCALAR;
+	}();
+	return level;
+#elif defined(USE_X86_SIMD)
+	static const SimdLevel level =
+		__builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_SCALAR;
+	return level;
+#elif defined(USE_NEON_SIMD)
+	return SIMD_NEON;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+#endif
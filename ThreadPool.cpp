@@ -0,0 +1,73 @@
+/*
+#  File        : ThreadPool.cpp
+#  Description : Persistent worker threads for the parallel stages
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#include "ThreadPool.h"
+#include<algorithm>
+
+/* thread_num threads including the caller of run() */
+ThreadPool::ThreadPool(int thread_num) : function(NULL), task(NULL),
+	task_num(0), next_task(0), active(0), generation(0), quit(false) {
+	for (int i = 1; i < thread_num; ++i)
+		workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+	return pool;
+}
+
+void ThreadPool::run(int _task_num, Function _function, void* _task) {
+	if (_task_num <= 1 || workers.empty()) { // not worth waking anyone
+		for (int i = 0; i < _task_num; ++i) _function(_task, i);
+		return;
+	}
+	std::lock_guard<std::mutex> serial(run_lock);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		function = _function;
+		task = _task;
+		task_num = _task_num;
+		next_task = 0;
+		active = (int)workers.size();
+		++generation;
+	}
+	wake.notify_all();
+	runTasks();
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this] { return active == 0; });
+}
+
+/* Take indices of the current run until there are none left */
+void ThreadPool::runTasks() {
+	for (int i = next_task++; i < task_num; i = next_task++)
+		function(task, i);
+}
+
+void ThreadPool::work() {
+	unsigned long seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [&] { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+		}
+		runTasks();
+		std::lock_guard<std::mutex> guard(lock);
+		if (--active == 0) done.notify_one();
+	}
+}
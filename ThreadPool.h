@@ -0,0 +1,59 @@
+/*
+#  File        : ThreadPool.h
+#  Description : Persistent worker threads for the parallel stages
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#pragma once
+#ifndef _ThreadPool_
+#define _ThreadPool_
+#include<atomic>
+#include<condition_variable>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+/* Threads are started once and wait for work, so a parallel stage
+*  costs neither a thread start nor a heap allocation per image.
+*  run(n, task) calls task(i) for every i in [0, n) on the workers and
+*  the calling thread, and returns when all of them are done. Which
+*  thread runs which index is not fixed, so results must only depend
+*  on the index. A task must not call run() itself. */
+class ThreadPool {
+private:
+	typedef void(*Function)(void* task, int index);
+	template<typename Task>
+	static void call(void* task, int index) { (*(Task*)task)(index); }
+
+	std::vector<std::thread> workers;
+	std::mutex run_lock; // one run at a time
+	std::mutex lock;
+	std::condition_variable wake, done;
+	Function function;
+	void* task;
+	int task_num;
+	std::atomic<int> next_task;
+	int active; // workers still busy with the current run
+	unsigned long generation; // number of runs, wakes up the workers
+	bool quit;
+
+	void run(int _task_num, Function _function, void* _task);
+	void runTasks();
+	void work();
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+public:
+	ThreadPool(int thread_num);
+	~ThreadPool();
+	/* Pool of all hardware threads shared by every stage */
+	static ThreadPool& shared();
+	int size() const { return (int)workers.size() + 1; } // with the caller
+	template<typename Task>
+	void run(int _task_num, Task& _task) {
+		run(_task_num, &call<Task>, &_task);
+	}
+};
+
+#endif
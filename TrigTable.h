@@ -0,0 +1,58 @@
+/*
+#  File        : TrigTable.h
+#  Description : Precomputed cosine and sine tables for Hough voting
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#pragma once
+#ifndef _TrigTable_
+#define _TrigTable_
+#include "CImg.h"
+#include<cmath>
+#include<map>
+#include<mutex>
+#include<vector>
+
+/* cos(theta) and sin(theta) of every angle bin of hough space.
+*  Angle bin i stands for theta = i / bins_per_degree degree and the
+*  table covers the whole circle (360 * bins_per_degree bins).
+*  Tables are built once per resolution and shared afterwards, so the
+*  voting loop only does two loads per angle instead of two libm calls. */
+class TrigTable {
+private:
+	int bins_per_degree;
+	std::vector<double> cos_table, sin_table;
+
+	TrigTable(int _bins_per_degree) : bins_per_degree(_bins_per_degree),
+		cos_table(360 * _bins_per_degree), sin_table(360 * _bins_per_degree) {
+		for (int i = 0; i < size(); ++i) {
+			// same expression as the original voting loop, so the
+			// table gives exactly the same rho values
+			double theta = 1.0 * i * cimg_library::cimg::PI / (180.0 * bins_per_degree);
+			cos_table[i] = cos(theta);
+			sin_table[i] = sin(theta);
+		}
+	}
+public:
+	/* Get the (cached) table of the given angle resolution */
+	static const TrigTable& get(int bins_per_degree = 1) {
+		static std::mutex lock;
+		static std::map<int, TrigTable> tables;
+		std::lock_guard<std::mutex> guard(lock);
+		std::map<int, TrigTable>::iterator it = tables.find(bins_per_degree);
+		if (it == tables.end())
+			it = tables.insert(std::make_pair(bins_per_degree,
+				TrigTable(bins_per_degree))).first;
+		return it->second;
+	}
+	int size() const { return (int)cos_table.size(); }
+	int binsPerDegree() const { return bins_per_degree; }
+	double cosAt(int angle) const { return cos_table[angle]; }
+	double sinAt(int angle) const { return sin_table[angle]; }
+	const double* cosData() const { return cos_table.data(); }
+	const double* sinData() const { return sin_table.data(); }
+};
+
+#endif
@@ -7,23 +7,705 @@
 */
 
 #include "Warping.h"
-Warping::Warping(Hough hough) {
-	src = hough.getRGBImg();
-	CImg<double> temp(W, H, 1, 3, 0);
-	dest_A4 = temp;
-	std::vector<Point>  corners = hough.getOrderedCorners();
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+#include<thread>
+
+// the scalar and AVX2 kernels down to gatherRow8Avx2 (and the cached
+// tables) must give the same crop, so none of them uses FMAs: every
+// product is rounded on its own
+SIMD_NO_FMA_BEGIN
+
+/* Bilinear sample of all three channels at (x, y) of an interleaved
+*  image of the given width: the weights are computed once */
+static inline void bilinearInterpolate(const float* rgb, int width,
+	float x, float y, float* out) {
+	int i = floorf(x), j = floorf(y);
+	float a = x - i, b = y - j;
+	float w00 = (1 - a)*(1 - b), w10 = a*(1 - b),
+		w01 = (1 - a)*b, w11 = a*b;
+	const float* p0 = rgb + 3 * (i + (size_t)j * width); // row j
+	const float* p1 = p0 + 3 * (size_t)width; // row j + 1
+	for (int c = 0; c < 3; ++c) // c indicates color channels
+		out[c] = w00*p0[c] + w10*p0[3 + c] + w01*p1[c] + w11*p1[3 + c];
+}
+
+/* Bilinear sample like bilinearInterpolate for any (x, y) of an
+*  interleaved width * height image, pixels out of it are clamped */
+static inline void bilinearClamped(const float* rgb, int width, int height,
+	float x, float y, float* out) {
+	x = std::min(std::max(x, 0.0f), width - 1.0f);
+	y = std::min(std::max(y, 0.0f), height - 1.0f);
+	int i = (int)x, j = (int)y;
+	float a = x - i, b = y - j;
+	float w00 = (1 - a)*(1 - b), w10 = a*(1 - b),
+		w01 = (1 - a)*b, w11 = a*b;
+	int di = i + 1 < width ? 3 : 0; // next pixel in the row
+	const float* p0 = rgb + 3 * (i + (size_t)j * width); // row j
+	const float* p1 = j + 1 < height ? p0 + 3 * (size_t)width : p0;
+	for (int c = 0; c < 3; ++c)
+		out[c] = w00*p0[c] + w10*p0[di + c] + w01*p1[c] + w11*p1[di + c];
+}
+
+/* Sample n pixels of a destination row from the interleaved source
+*  rgb of src_w * src_h pixels. The first pixel maps to the homogeneous
+*  source point (X, Y, Z), each next one adds step. Pixels falling
+*  outside of the source are black. */
+static void warpRowScalar(const float* rgb, int src_w, int src_h,
+	double X, double Y, double Z, const double* step, int n,
+	float* dest_r, float* dest_g, float* dest_b) {
+	for (int u = 0; u < n; ++u) {
+		double r = 1 / Z;
+		float x = X * r, y = Y * r;
+		if (x >= 0 && y >= 0 && x + 1 < src_w && y + 1 < src_h) {
+			float pixel[3];
+			bilinearInterpolate(rgb, src_w, x, y, pixel);
+			dest_r[u] = pixel[0];
+			dest_g[u] = pixel[1];
+			dest_b[u] = pixel[2];
+		}
+		else {
+			dest_r[u] = dest_g[u] = dest_b[u] = 0;
+		}
+		X += step[0], Y += step[1], Z += step[2];
+	}
+}
+
+#ifdef USE_X86_SIMD
+/* 8 pixels per loop with gathers. X, Y and Z are stepped and divided
+*  in double and every float operation is done in the order of the
+*  scalar kernel (no fused multiply-add), so both give exactly the same
+*  image. */
+SIMD_TARGET_AVX2
+static void warpRowAvx2(const float* rgb, int src_w, int src_h,
+	double X, double Y, double Z, const double* step, int n,
+	float* dest_r, float* dest_g, float* dest_b) {
+	const __m256d one_d = _mm256_set1_pd(1);
+	const __m256 one = _mm256_set1_ps(1), zero = _mm256_setzero_ps();
+	const __m256 width = _mm256_set1_ps((float)src_w),
+		height = _mm256_set1_ps((float)src_h);
+	const __m256i three = _mm256_set1_epi32(3),
+		row = _mm256_set1_epi32(3 * src_w);
+	float* dest[3] = { dest_r, dest_g, dest_b };
+	double xs[8], ys[8], zs[8];
+	int u = 0;
+	for (; u + 8 <= n; u += 8) {
+		for (int k = 0; k < 8; ++k) { // same sums as the scalar kernel
+			xs[k] = X, ys[k] = Y, zs[k] = Z;
+			X += step[0], Y += step[1], Z += step[2];
+		}
+		__m256d r0 = _mm256_div_pd(one_d, _mm256_loadu_pd(zs));
+		__m256d r1 = _mm256_div_pd(one_d, _mm256_loadu_pd(zs + 4));
+		__m256 x = _mm256_set_m128(
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(xs + 4), r1)),
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(xs), r0)));
+		__m256 y = _mm256_set_m128(
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(ys + 4), r1)),
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(ys), r0)));
+		__m256 inside = _mm256_and_ps(
+			_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ),
+				_mm256_cmp_ps(y, zero, _CMP_GE_OQ)),
+			_mm256_and_ps(
+				_mm256_cmp_ps(_mm256_add_ps(x, one), width, _CMP_LT_OQ),
+				_mm256_cmp_ps(_mm256_add_ps(y, one), height, _CMP_LT_OQ)));
+		if (_mm256_movemask_ps(inside) == 0) {
+			for (int c = 0; c < 3; ++c) _mm256_storeu_ps(dest[c] + u, zero);
+			continue;
+		}
+		__m256 fx = _mm256_floor_ps(x), fy = _mm256_floor_ps(y);
+		__m256 a = _mm256_sub_ps(x, fx), b = _mm256_sub_ps(y, fy);
+		__m256 ia = _mm256_sub_ps(one, a), ib = _mm256_sub_ps(one, b);
+		__m256 w00 = _mm256_mul_ps(ia, ib), w10 = _mm256_mul_ps(a, ib),
+			w01 = _mm256_mul_ps(ia, b), w11 = _mm256_mul_ps(a, b);
+		// offset of pixel (i, j), lanes outside of the source read pixel 0
+		// and are set to black
+		__m256i p0 = _mm256_add_epi32(
+			_mm256_mullo_epi32(_mm256_cvttps_epi32(fx), three),
+			_mm256_mullo_epi32(_mm256_cvttps_epi32(fy), row));
+		p0 = _mm256_and_si256(p0, _mm256_castps_si256(inside));
+		__m256i p1 = _mm256_add_epi32(p0, row);
+		for (int c = 0; c < 3; ++c) {
+			const float* channel = rgb + c;
+			__m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(w00, _mm256_i32gather_ps(channel, p0, 4)),
+				_mm256_mul_ps(w10, _mm256_i32gather_ps(channel + 3, p0, 4))),
+				_mm256_mul_ps(w01, _mm256_i32gather_ps(channel, p1, 4))),
+				_mm256_mul_ps(w11, _mm256_i32gather_ps(channel + 3, p1, 4)));
+			_mm256_storeu_ps(dest[c] + u, _mm256_and_ps(v, inside));
+		}
+	}
+	warpRowScalar(rgb, src_w, src_h, X, Y, Z, step, n - u,
+		dest_r + u, dest_g + u, dest_b + u);
+}
+#endif
+
+/* Sub-pixel positions of the 8-bit path are fixed-point numbers with
+*  FRACTION_BITS bits after the point, a source pixel has 256 steps */
+static const int FRACTION_BITS = 8;
+static const int FRACTION_ONE = 1 << FRACTION_BITS;
+
+/* warpRowScalar on an 8-bit interleaved source. x and y are computed
+*  like in the float kernels, then truncated to fixed point: x >= 0 so
+*  the integer part is floor(x) and the pixel right of it is inside.
+*  The four integer weights add up to 2^16, the sum of a channel fits
+*  in 32 bits and is rounded back to 8 bits by a shift. */
+static void warpRow8Scalar(const unsigned char* rgb, int src_w, int src_h,
+	double X, double Y, double Z, const double* step, int n,
+	unsigned char* dest_r, unsigned char* dest_g, unsigned char* dest_b) {
+	unsigned char* dest[3] = { dest_r, dest_g, dest_b };
+	for (int u = 0; u < n; ++u) {
+		double r = 1 / Z;
+		float x = X * r, y = Y * r;
+		if (x >= 0 && y >= 0 && x + 1 < src_w && y + 1 < src_h) {
+			int fx = (int)(x * FRACTION_ONE), fy = (int)(y * FRACTION_ONE);
+			int i = fx >> FRACTION_BITS, j = fy >> FRACTION_BITS;
+			int a = fx & (FRACTION_ONE - 1), b = fy & (FRACTION_ONE - 1);
+			int w00 = (FRACTION_ONE - a) * (FRACTION_ONE - b),
+				w10 = a * (FRACTION_ONE - b), w01 = (FRACTION_ONE - a) * b,
+				w11 = a * b;
+			const unsigned char* p0 = rgb + 3 * (i + (size_t)j * src_w);
+			const unsigned char* p1 = p0 + 3 * (size_t)src_w;
+			for (int c = 0; c < 3; ++c)
+				dest[c][u] = (w00*p0[c] + w10*p0[3 + c] + w01*p1[c] + w11*p1[3 + c]
+					+ (1 << (2 * FRACTION_BITS - 1))) >> (2 * FRACTION_BITS);
+		}
+		else {
+			dest_r[u] = dest_g[u] = dest_b[u] = 0;
+		}
+		X += step[0], Y += step[1], Z += step[2];
+	}
+}
+
+#ifdef USE_X86_SIMD
+/* warpRow8Scalar for 8 pixels per loop. One 32-bit gather reads the
+*  three channels of a source pixel at once (and a byte of the next
+*  one), so a pixel costs 4 gathers instead of the 12 of warpRowAvx2.
+*  The source needs one byte of padding after the last pixel. Gives
+*  exactly the image of the scalar kernel. */
+SIMD_TARGET_AVX2
+static void warpRow8Avx2(const unsigned char* rgb, int src_w, int src_h,
+	double X, double Y, double Z, const double* step, int n,
+	unsigned char* dest_r, unsigned char* dest_g, unsigned char* dest_b) {
+	const __m256d one_d = _mm256_set1_pd(1);
+	const __m256 one = _mm256_set1_ps(1), zero = _mm256_setzero_ps(),
+		fraction_one = _mm256_set1_ps((float)FRACTION_ONE);
+	const __m256 width = _mm256_set1_ps((float)src_w),
+		height = _mm256_set1_ps((float)src_h);
+	const __m256i three = _mm256_set1_epi32(3),
+		row = _mm256_set1_epi32(3 * src_w),
+		fraction_mask = _mm256_set1_epi32(FRACTION_ONE - 1),
+		fraction_one_i = _mm256_set1_epi32(FRACTION_ONE),
+		byte = _mm256_set1_epi32(0xff),
+		half = _mm256_set1_epi32(1 << (2 * FRACTION_BITS - 1));
+	const int* base = (const int*)rgb;
+	unsigned char* dest[3] = { dest_r, dest_g, dest_b };
+	double xs[8], ys[8], zs[8];
+	int u = 0;
+	for (; u + 8 <= n; u += 8) {
+		for (int k = 0; k < 8; ++k) { // same sums as the scalar kernel
+			xs[k] = X, ys[k] = Y, zs[k] = Z;
+			X += step[0], Y += step[1], Z += step[2];
+		}
+		__m256d r0 = _mm256_div_pd(one_d, _mm256_loadu_pd(zs));
+		__m256d r1 = _mm256_div_pd(one_d, _mm256_loadu_pd(zs + 4));
+		__m256 x = _mm256_set_m128(
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(xs + 4), r1)),
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(xs), r0)));
+		__m256 y = _mm256_set_m128(
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(ys + 4), r1)),
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(ys), r0)));
+		__m256 inside = _mm256_and_ps(
+			_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ),
+				_mm256_cmp_ps(y, zero, _CMP_GE_OQ)),
+			_mm256_and_ps(
+				_mm256_cmp_ps(_mm256_add_ps(x, one), width, _CMP_LT_OQ),
+				_mm256_cmp_ps(_mm256_add_ps(y, one), height, _CMP_LT_OQ)));
+		if (_mm256_movemask_ps(inside) == 0) {
+			for (int c = 0; c < 3; ++c) memset(dest[c] + u, 0, 8);
+			continue;
+		}
+		__m256i mask = _mm256_castps_si256(inside);
+		// lanes outside of the source read pixel 0 and are set to black
+		__m256i fx = _mm256_and_si256(
+			_mm256_cvttps_epi32(_mm256_mul_ps(x, fraction_one)), mask);
+		__m256i fy = _mm256_and_si256(
+			_mm256_cvttps_epi32(_mm256_mul_ps(y, fraction_one)), mask);
+		__m256i a = _mm256_and_si256(fx, fraction_mask),
+			b = _mm256_and_si256(fy, fraction_mask);
+		__m256i ia = _mm256_sub_epi32(fraction_one_i, a),
+			ib = _mm256_sub_epi32(fraction_one_i, b);
+		__m256i w00 = _mm256_mullo_epi32(ia, ib), w10 = _mm256_mullo_epi32(a, ib),
+			w01 = _mm256_mullo_epi32(ia, b), w11 = _mm256_mullo_epi32(a, b);
+		__m256i p0 = _mm256_add_epi32(
+			_mm256_mullo_epi32(_mm256_srli_epi32(fx, FRACTION_BITS), three),
+			_mm256_mullo_epi32(_mm256_srli_epi32(fy, FRACTION_BITS), row));
+		__m256i p1 = _mm256_add_epi32(p0, row);
+		__m256i q00 = _mm256_i32gather_epi32(base, p0, 1),
+			q10 = _mm256_i32gather_epi32((const int*)(rgb + 3), p0, 1),
+			q01 = _mm256_i32gather_epi32(base, p1, 1),
+			q11 = _mm256_i32gather_epi32((const int*)(rgb + 3), p1, 1);
+		for (int c = 0; c < 3; ++c) {
+			__m256i v = _mm256_add_epi32(_mm256_add_epi32(
+				_mm256_mullo_epi32(w00, _mm256_and_si256(q00, byte)),
+				_mm256_mullo_epi32(w10, _mm256_and_si256(q10, byte))),
+				_mm256_add_epi32(
+				_mm256_mullo_epi32(w01, _mm256_and_si256(q01, byte)),
+				_mm256_mullo_epi32(w11, _mm256_and_si256(q11, byte))));
+			v = _mm256_srli_epi32(_mm256_add_epi32(v, half), 2 * FRACTION_BITS);
+			v = _mm256_and_si256(v, mask);
+			// 8 lanes of 32 bits to 8 bytes
+			v = _mm256_packus_epi16(_mm256_packus_epi32(v, v), v);
+			_mm_storel_epi64((__m128i*)(dest[c] + u), _mm_unpacklo_epi32(
+				_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+			q00 = _mm256_srli_epi32(q00, 8), q10 = _mm256_srli_epi32(q10, 8);
+			q01 = _mm256_srli_epi32(q01, 8), q11 = _mm256_srli_epi32(q11, 8);
+		}
+	}
+	warpRow8Scalar(rgb, src_w, src_h, X, Y, Z, step, n - u,
+		dest_r + u, dest_g + u, dest_b + u);
+}
+#endif
+
+/* Remap table of a destination row: the source pixels warpRowScalar
+*  would sample for it, from the same sums, with the fixed-point
+*  fractions of warpRow8Scalar */
+static void remapRowScalar(int src_w, int src_h, double X, double Y, double Z,
+	const double* step, int n, int* index, unsigned short* fraction) {
+	for (int u = 0; u < n; ++u) {
+		double r = 1 / Z;
+		float x = X * r, y = Y * r;
+		if (x >= 0 && y >= 0 && x + 1 < src_w && y + 1 < src_h) {
+			int fx = (int)(x * FRACTION_ONE), fy = (int)(y * FRACTION_ONE);
+			index[u] = (fx >> FRACTION_BITS) + (fy >> FRACTION_BITS) * src_w;
+			fraction[u] = (unsigned short)((fx & (FRACTION_ONE - 1)) |
+				(fy & (FRACTION_ONE - 1)) << FRACTION_BITS);
+		}
+		else {
+			index[u] = -1;
+			fraction[u] = 0;
+		}
+		X += step[0], Y += step[1], Z += step[2];
+	}
+}
+
+#ifdef USE_X86_SIMD
+/* remapRowScalar for 8 pixels per loop, with the coordinates and the
+*  bounds of warpRow8Avx2. Gives exactly the table of the scalar
+*  kernel. */
+SIMD_TARGET_AVX2
+static void remapRowAvx2(int src_w, int src_h, double X, double Y, double Z,
+	const double* step, int n, int* index, unsigned short* fraction) {
+	const __m256d one_d = _mm256_set1_pd(1);
+	const __m256 one = _mm256_set1_ps(1), zero = _mm256_setzero_ps(),
+		fraction_one = _mm256_set1_ps((float)FRACTION_ONE);
+	const __m256 width = _mm256_set1_ps((float)src_w),
+		height = _mm256_set1_ps((float)src_h);
+	const __m256i row = _mm256_set1_epi32(src_w),
+		fraction_mask = _mm256_set1_epi32(FRACTION_ONE - 1),
+		outside = _mm256_set1_epi32(-1);
+	double xs[8], ys[8], zs[8];
+	int u = 0;
+	for (; u + 8 <= n; u += 8) {
+		for (int k = 0; k < 8; ++k) { // same sums as the scalar kernel
+			xs[k] = X, ys[k] = Y, zs[k] = Z;
+			X += step[0], Y += step[1], Z += step[2];
+		}
+		__m256d r0 = _mm256_div_pd(one_d, _mm256_loadu_pd(zs));
+		__m256d r1 = _mm256_div_pd(one_d, _mm256_loadu_pd(zs + 4));
+		__m256 x = _mm256_set_m128(
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(xs + 4), r1)),
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(xs), r0)));
+		__m256 y = _mm256_set_m128(
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(ys + 4), r1)),
+			_mm256_cvtpd_ps(_mm256_mul_pd(_mm256_loadu_pd(ys), r0)));
+		__m256i inside = _mm256_castps_si256(_mm256_and_ps(
+			_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ),
+				_mm256_cmp_ps(y, zero, _CMP_GE_OQ)),
+			_mm256_and_ps(
+				_mm256_cmp_ps(_mm256_add_ps(x, one), width, _CMP_LT_OQ),
+				_mm256_cmp_ps(_mm256_add_ps(y, one), height, _CMP_LT_OQ))));
+		__m256i fx = _mm256_cvttps_epi32(_mm256_mul_ps(x, fraction_one));
+		__m256i fy = _mm256_cvttps_epi32(_mm256_mul_ps(y, fraction_one));
+		__m256i i = _mm256_add_epi32(_mm256_srli_epi32(fx, FRACTION_BITS),
+			_mm256_mullo_epi32(_mm256_srli_epi32(fy, FRACTION_BITS), row));
+		__m256i f = _mm256_or_si256(_mm256_and_si256(fx, fraction_mask),
+			_mm256_slli_epi32(_mm256_and_si256(fy, fraction_mask), FRACTION_BITS));
+		// lanes outside of the source get -1 and no fraction
+		_mm256_storeu_si256((__m256i*)(index + u),
+			_mm256_blendv_epi8(outside, i, inside));
+		f = _mm256_and_si256(f, inside);
+		_mm_storeu_si128((__m128i*)(fraction + u), _mm_packus_epi32(
+			_mm256_castsi256_si128(f), _mm256_extracti128_si256(f, 1)));
+	}
+	remapRowScalar(src_w, src_h, X, Y, Z, step, n - u, index + u, fraction + u);
+}
+#endif
+
+/* Destination row of n pixels from its remap table and the planar
+*  source src of src_w pixels per row and plane pixels per channel,
+*  with the arithmetic of bilinearInterpolate */
+static void gatherRowScalar(const int* index, const unsigned short* fraction,
+	const float* src, int src_w, size_t plane, int n,
+	float* dest_r, float* dest_g, float* dest_b) {
+	float* dest[3] = { dest_r, dest_g, dest_b };
+	const float scale = 1.0f / FRACTION_ONE;
+	for (int u = 0; u < n; ++u) {
+		if (index[u] < 0) {
+			dest_r[u] = dest_g[u] = dest_b[u] = 0;
+			continue;
+		}
+		float a = (fraction[u] & (FRACTION_ONE - 1)) * scale,
+			b = (fraction[u] >> FRACTION_BITS) * scale;
+		float w00 = (1 - a)*(1 - b), w10 = a*(1 - b),
+			w01 = (1 - a)*b, w11 = a*b;
+		const float* p0 = src + index[u]; // row j
+		for (int c = 0; c < 3; ++c, p0 += plane) {
+			const float* p1 = p0 + src_w; // row j + 1
+			dest[c][u] = w00*p0[0] + w10*p0[1] + w01*p1[0] + w11*p1[1];
+		}
+	}
+}
+
+/* gatherRowScalar for 8-bit images with the arithmetic of
+*  warpRow8Scalar, so the crop is exactly the one without table */
+static void gatherRow8Scalar(const int* index, const unsigned short* fraction,
+	const unsigned char* src, int src_w, size_t plane, int n,
+	unsigned char* dest_r, unsigned char* dest_g, unsigned char* dest_b) {
+	unsigned char* dest[3] = { dest_r, dest_g, dest_b };
+	for (int u = 0; u < n; ++u) {
+		if (index[u] < 0) {
+			dest_r[u] = dest_g[u] = dest_b[u] = 0;
+			continue;
+		}
+		int a = fraction[u] & (FRACTION_ONE - 1), b = fraction[u] >> FRACTION_BITS;
+		int w00 = (FRACTION_ONE - a) * (FRACTION_ONE - b),
+			w10 = a * (FRACTION_ONE - b), w01 = (FRACTION_ONE - a) * b,
+			w11 = a * b;
+		const unsigned char* p0 = src + index[u];
+		for (int c = 0; c < 3; ++c, p0 += plane) {
+			const unsigned char* p1 = p0 + src_w;
+			dest[c][u] = (w00*p0[0] + w10*p0[1] + w01*p1[0] + w11*p1[1]
+				+ (1 << (2 * FRACTION_BITS - 1))) >> (2 * FRACTION_BITS);
+		}
+	}
+}
+
+#ifdef USE_X86_SIMD
+/* gatherRowScalar for 8 pixels per loop with the same products and
+*  sums. Lanes outside of the source read pixel 0 and are set to black. */
+SIMD_TARGET_AVX2
+static void gatherRowAvx2(const int* index, const unsigned short* fraction,
+	const float* src, int src_w, size_t plane, int n,
+	float* dest_r, float* dest_g, float* dest_b) {
+	const __m256 one = _mm256_set1_ps(1),
+		scale = _mm256_set1_ps(1.0f / FRACTION_ONE);
+	const __m256i minus_one = _mm256_set1_epi32(-1),
+		row = _mm256_set1_epi32(src_w),
+		fraction_mask = _mm256_set1_epi32(FRACTION_ONE - 1);
+	float* dest[3] = { dest_r, dest_g, dest_b };
+	int u = 0;
+	for (; u + 8 <= n; u += 8) {
+		__m256i p0 = _mm256_loadu_si256((const __m256i*)(index + u));
+		__m256i mask = _mm256_cmpgt_epi32(p0, minus_one);
+		p0 = _mm256_and_si256(p0, mask);
+		__m256i p1 = _mm256_add_epi32(p0, row);
+		__m256i f = _mm256_cvtepu16_epi32(
+			_mm_loadu_si128((const __m128i*)(fraction + u)));
+		__m256 a = _mm256_mul_ps(_mm256_cvtepi32_ps(
+			_mm256_and_si256(f, fraction_mask)), scale);
+		__m256 b = _mm256_mul_ps(_mm256_cvtepi32_ps(
+			_mm256_srli_epi32(f, FRACTION_BITS)), scale);
+		__m256 ia = _mm256_sub_ps(one, a), ib = _mm256_sub_ps(one, b);
+		__m256 w00 = _mm256_mul_ps(ia, ib), w10 = _mm256_mul_ps(a, ib),
+			w01 = _mm256_mul_ps(ia, b), w11 = _mm256_mul_ps(a, b);
+		__m256 inside = _mm256_castsi256_ps(mask);
+		const float* channel = src;
+		for (int c = 0; c < 3; ++c, channel += plane) {
+			__m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(w00, _mm256_i32gather_ps(channel, p0, 4)),
+				_mm256_mul_ps(w10, _mm256_i32gather_ps(channel + 1, p0, 4))),
+				_mm256_mul_ps(w01, _mm256_i32gather_ps(channel, p1, 4))),
+				_mm256_mul_ps(w11, _mm256_i32gather_ps(channel + 1, p1, 4)));
+			_mm256_storeu_ps(dest[c] + u, _mm256_and_ps(v, inside));
+		}
+	}
+	gatherRowScalar(index + u, fraction + u, src, src_w, plane, n - u,
+		dest_r + u, dest_g + u, dest_b + u);
+}
+
+/* gatherRow8Scalar for 8 pixels per loop. A 32-bit gather reads both
+*  pixels of row j at p0 and one at p1 - 2 both pixels of row j + 1 in
+*  its upper bytes; neither reads past the plane. */
+SIMD_TARGET_AVX2
+static void gatherRow8Avx2(const int* index, const unsigned short* fraction,
+	const unsigned char* src, int src_w, size_t plane, int n,
+	unsigned char* dest_r, unsigned char* dest_g, unsigned char* dest_b) {
+	const __m256i minus_one = _mm256_set1_epi32(-1),
+		row = _mm256_set1_epi32(src_w),
+		fraction_mask = _mm256_set1_epi32(FRACTION_ONE - 1),
+		fraction_one = _mm256_set1_epi32(FRACTION_ONE),
+		byte = _mm256_set1_epi32(0xff),
+		half = _mm256_set1_epi32(1 << (2 * FRACTION_BITS - 1));
+	unsigned char* dest[3] = { dest_r, dest_g, dest_b };
+	int u = 0;
+	for (; u + 8 <= n; u += 8) {
+		__m256i p0 = _mm256_loadu_si256((const __m256i*)(index + u));
+		__m256i mask = _mm256_cmpgt_epi32(p0, minus_one);
+		p0 = _mm256_and_si256(p0, mask);
+		__m256i p1 = _mm256_add_epi32(p0, row);
+		__m256i f = _mm256_cvtepu16_epi32(
+			_mm_loadu_si128((const __m128i*)(fraction + u)));
+		__m256i a = _mm256_and_si256(f, fraction_mask),
+			b = _mm256_srli_epi32(f, FRACTION_BITS);
+		__m256i ia = _mm256_sub_epi32(fraction_one, a),
+			ib = _mm256_sub_epi32(fraction_one, b);
+		__m256i w00 = _mm256_mullo_epi32(ia, ib), w10 = _mm256_mullo_epi32(a, ib),
+			w01 = _mm256_mullo_epi32(ia, b), w11 = _mm256_mullo_epi32(a, b);
+		const unsigned char* channel = src;
+		for (int c = 0; c < 3; ++c, channel += plane) {
+			__m256i q0 = _mm256_i32gather_epi32((const int*)channel, p0, 1),
+				q1 = _mm256_i32gather_epi32((const int*)(channel - 2), p1, 1);
+			__m256i v = _mm256_add_epi32(_mm256_add_epi32(
+				_mm256_mullo_epi32(w00, _mm256_and_si256(q0, byte)),
+				_mm256_mullo_epi32(w10, _mm256_and_si256(_mm256_srli_epi32(q0, 8), byte))),
+				_mm256_add_epi32(
+				_mm256_mullo_epi32(w01, _mm256_and_si256(_mm256_srli_epi32(q1, 16), byte)),
+				_mm256_mullo_epi32(w11, _mm256_srli_epi32(q1, 24))));
+			v = _mm256_srli_epi32(_mm256_add_epi32(v, half), 2 * FRACTION_BITS);
+			v = _mm256_and_si256(v, mask);
+			// 8 lanes of 32 bits to 8 bytes
+			v = _mm256_packus_epi16(_mm256_packus_epi32(v, v), v);
+			_mm_storel_epi64((__m128i*)(dest[c] + u), _mm_unpacklo_epi32(
+				_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+		}
+	}
+	gatherRow8Scalar(index + u, fraction + u, src, src_w, plane, n - u,
+		dest_r + u, dest_g + u, dest_b + u);
+}
+#endif
+
+SIMD_NO_FMA_END
+
+/* Copy rows [first, last) of the three colour planes of planes into
+*  the interleaved rgb */
+template<typename T>
+static void interleaveRows(const CImg<T>& planes, T* rgb, int first, int last) {
+	size_t begin = (size_t)first * planes.width(),
+		end = (size_t)last * planes.width();
+	const T *r = planes.data(0, 0, 0, 0), *g = planes.data(0, 0, 0, 1),
+		*b = planes.data(0, 0, 0, 2);
+	rgb += 3 * begin;
+	for (size_t i = begin; i < end; ++i) {
+		*(rgb++) = r[i];
+		*(rgb++) = g[i];
+		*(rgb++) = b[i];
+	}
+}
+
+/* Width and height of page in millimetres */
+static void pageSize(PageFormat page, float& width, float& height) {
+	switch (page) {
+	case PAGE_A5:
+		width = 148, height = 210;
+		return;
+	case PAGE_LETTER: // 8.5 * 11 inch
+		width = 215.9f, height = 279.4f;
+		return;
+	default:
+		width = 210, height = 297;
+	}
+}
+
+void WarpOptions::setPage(PageFormat page, float dpi) {
+	float page_w, page_h;
+	pageSize(page, page_w, page_h);
+	width = std::max(1, (int)(page_w / 25.4f * dpi + 0.5f));
+	height = std::max(1, (int)(page_h / 25.4f * dpi + 0.5f));
+}
+
+/* Call rows(first, last) for the rows [0, height) in tiles of
+*  TILE_ROWS rows on the shared thread pool. Task t takes the tiles t,
+*  t + thread_num, ... so the rows do not depend on the threads. */
+template<typename Rows>
+void Warping::forEachTile(int height, Rows& rows) {
+	int tile_num = (height + TILE_ROWS - 1) / TILE_ROWS;
+	int thread_num = threadNum(tile_num);
+	auto tiles = [&](int t) {
+		for (int tile = t; tile < tile_num; tile += thread_num)
+			rows(tile * TILE_ROWS, std::min(height, (tile + 1) * TILE_ROWS));
+	};
+	ThreadPool::shared().run(thread_num, tiles);
+}
+
+Warping::Warping(const CImg<float>& src_img, const std::vector<Point>& corners,
+	WarpOptions _options, Workspace* workspace) : options(_options) {
+	warp(src_img, corners, workspace);
+}
+
+Warping::Warping(const Hough& hough, WarpOptions _options,
+	Workspace* workspace) : options(_options) {
+	warp(hough.getRGBImg(), hough.getOrderedCorners(), workspace);
+}
+
+Warping::Warping(const CImg<unsigned char>& src_img,
+	const std::vector<Point>& corners, WarpOptions _options,
+	Workspace* workspace) : options(_options) {
+	warp8(src_img, corners, workspace);
+}
+
+void Warping::warp(const CImg<float>& src_img,
+	const std::vector<Point>& corners, Workspace* workspace) {
+	src.assign(src_img, true); // only read
+	row_kernel = warpRowScalar;
+	remap_kernel = remapRowScalar;
+	gather_kernel = gatherRowScalar;
+#ifdef USE_X86_SIMD
+	if (options.simd && simdLevel() == SIMD_AVX2) {
+		row_kernel = warpRowAvx2;
+		remap_kernel = remapRowAvx2;
+		gather_kernel = gatherRowAvx2;
+	}
+#endif
+	// every pixel is written by reverseMapping, no need to clear
+	if (workspace)
+		workspace->warped.bind(dest_img, options.width, options.height, 1, 3);
+	else dest_img.assign(options.width, options.height, 1, 3);
+	cropped = corners.size() == 4;
+	if (!cropped) { // e.g. a failed detection, see ok()
+		dest_img.fill(0);
+		return;
+	}
+	RemapTable table = remapTable(corners, src.width(), src.height());
+	if (table.index) {
+		size_t plane = (size_t)src.width() * src.height();
+		auto gatherRows = [&](int first, int last) {
+			for (int v = first; v < last; ++v) {
+				size_t offset = (size_t)v * dest_img.width();
+				gather_kernel(table.index + offset, table.fraction + offset,
+					src.data(), src.width(), plane, dest_img.width(),
+					dest_img.data(0, v, 0, 0), dest_img.data(0, v, 0, 1),
+					dest_img.data(0, v, 0, 2));
+			}
+		};
+		forEachTile(dest_img.height(), gatherRows);
+		return;
+	}
+	setCorners(corners);
+	interleaveSource(workspace);
+	if (options.filter == FILTER_MIPMAP) buildMipmap(workspace);
+	reverseMapping();
+}
+
+/* The float warp with 8-bit pixels: a quarter of the memory traffic
+*  of the float path for the source and the crop. Always bilinear. */
+void Warping::warp8(const CImg<unsigned char>& src_img,
+	const std::vector<Point>& corners, Workspace* workspace) {
+	src8.assign(src_img, true); // only read
+	row_kernel8 = warpRow8Scalar;
+	remap_kernel = remapRowScalar;
+	gather_kernel8 = gatherRow8Scalar;
+#ifdef USE_X86_SIMD
+	if (options.simd && simdLevel() == SIMD_AVX2) {
+		row_kernel8 = warpRow8Avx2;
+		remap_kernel = remapRowAvx2;
+		gather_kernel8 = gatherRow8Avx2;
+	}
+#endif
+	if (workspace)
+		workspace->warped8.bind(dest8_img, options.width, options.height, 1, 3);
+	else dest8_img.assign(options.width, options.height, 1, 3);
+	cropped = corners.size() == 4;
+	if (!cropped) {
+		dest8_img.fill(0);
+		return;
+	}
+	RemapTable table = remapTable(corners, src8.width(), src8.height());
+	if (table.index) {
+		size_t plane = (size_t)src8.width() * src8.height();
+		auto gatherRows = [&](int first, int last) {
+			for (int v = first; v < last; ++v) {
+				size_t offset = (size_t)v * dest8_img.width();
+				gather_kernel8(table.index + offset, table.fraction + offset,
+					src8.data(), src8.width(), plane, dest8_img.width(),
+					dest8_img.data(0, v, 0, 0), dest8_img.data(0, v, 0, 1),
+					dest8_img.data(0, v, 0, 2));
+			}
+		};
+		forEachTile(dest8_img.height(), gatherRows);
+		return;
+	}
+	setCorners(corners);
+	// the rows of src_rgb8 one after the other, plus the padding byte
+	// read by warpRow8Avx2 after the last pixel
+	int size = 3 * src8.width() * src8.height() + 1;
+	if (workspace) workspace->interleaved8.bind(src_rgb8, size, 1);
+	else src_rgb8.assign(size, 1);
+	src_rgb8[size - 1] = 0;
+	auto interleave = [&](int first, int last) {
+		interleaveRows(src8, src_rgb8.data(), first, last);
+	};
+	forEachTile(src8.height(), interleave);
+	const double step[] = { inv[0], inv[3], inv[6] };
+	auto warpRows = [&](int first, int last) {
+		for (int v = first; v < last; ++v)
+			row_kernel8(src_rgb8.data(), src8.width(), src8.height(),
+				inv[1] * v + inv[2], inv[4] * v + inv[5], inv[7] * v + inv[8],
+				step, dest8_img.width(), dest8_img.data(0, v, 0, 0),
+				dest8_img.data(0, v, 0, 1), dest8_img.data(0, v, 0, 2));
+	};
+	forEachTile(dest8_img.height(), warpRows);
+}
+
+/* Remap table of the crop from options.cache, built and added to the
+*  cache on a miss. NULL pointers without cache or with FILTER_MIPMAP.
+*  On a hit the homography is not computed at all. */
+RemapTable Warping::remapTable(const std::vector<Point>& corners,
+	int src_w, int src_h) {
+	RemapCache* cache = options.cache;
+	if (!cache || options.filter != FILTER_BILINEAR) return RemapTable();
+	RemapKey key;
+	for (int i = 0; i < 4; ++i)
+		key.corners[2 * i] = corners[i].x, key.corners[2 * i + 1] = corners[i].y;
+	key.src_w = src_w, key.src_h = src_h;
+	key.width = options.width, key.height = options.height;
+	RemapTable table = cache->find(key);
+	if (table.index) return table;
+	setCorners(corners);
+	table = cache->insert(key, (size_t)options.width * options.height);
+	const double step[] = { inv[0], inv[3], inv[6] };
+	auto remapRows = [&](int first, int last) {
+		for (int v = first; v < last; ++v) {
+			size_t offset = (size_t)v * options.width;
+			remap_kernel(src_w, src_h, inv[1] * v + inv[2], inv[4] * v + inv[5],
+				inv[7] * v + inv[8], step, options.width,
+				table.index + offset, table.fraction + offset);
+		}
+	};
+	forEachTile(options.height, remapRows);
+	return table;
+}
+
+/* Destination corners from the crop size and source corners, then the
+*  homography between them */
+void Warping::setCorners(const std::vector<Point>& corners) {
+	W = options.width, H = options.height;
+	u1 = 0, v1 = 0; // top-left
+	u2 = W - 1, v2 = 0; // top-right
+	u3 = 0, v3 = H - 1; // bottom-left
+	u4 = W - 1, v4 = H - 1; // bottom-right
 	x1 = corners[0].x, y1 = corners[0].y; // top-left
 	x2 = corners[1].x, y2 = corners[1].y; // top-right
 	x3 = corners[2].x, y3 = corners[2].y; // bottom-left
 	x4 = corners[3].x, y4 = corners[3].y; // bottom-right
 	perspectiveTransform();
-	reverseMapping();
 }
 
 void Warping::perspectiveTransform() {
-	Eigen::MatrixXf UV(8, 1);
-	Eigen::MatrixXf M = Eigen::MatrixXf::Constant(8, 1, 0);
-	Eigen::MatrixXf A(8, 8);
+	// fixed size matrices live on the stack
+	Eigen::Matrix<float, 8, 1> UV;
+	Eigen::Matrix<float, 8, 1> M = Eigen::Matrix<float, 8, 1>::Zero();
+	Eigen::Matrix<float, 8, 8> A;
 	UV << u1, v1, u2, v2, u3, v3, u4, v4;
 	A << x1, y1, 1, 0,  0,  0, -u1*x1, -u1*y1,
 		 0,  0,  0, x1, y1, 1, -v1*x1, -v1*y1,
@@ -36,31 +718,152 @@ void Warping::perspectiveTransform() {
 	M = A.inverse() * UV;
 	a = M(0,0), b = M(1, 0), c = M(2, 0), d = M(3, 0),
 		e = M(4, 0), f = M(5, 0), m = M(6, 0), l = M(7, 0);
+	// invert the homography (a b c; d e f; m l 1) once: its adjugate,
+	// the scale does not matter as x and y are ratios
+	inv[0] = e - f*l, inv[1] = c*l - b, inv[2] = b*f - c*e;
+	inv[3] = f*m - d, inv[4] = a - c*m, inv[5] = c*d - a*f;
+	inv[6] = d*l - e*m, inv[7] = b*m - a*l, inv[8] = a*e - b*d;
 }
 
-float Warping::getXTransformInv(int u, int v) {
-	return ((c - u)*(v*l - e) - (f - v)*(u*l - b)) /
-		((u*m - a)*(v*l - e) - (v*m - d)*(u*l - b));
+/* Copy the three colour planes of src into the interleaved src_rgb */
+void Warping::interleaveSource(Workspace* workspace) {
+	if (workspace) workspace->interleaved.bind(src_rgb, 3 * src.width(), src.height());
+	else src_rgb.assign(3 * src.width(), src.height());
+	auto interleave = [&](int first, int last) {
+		interleaveRows(src, src_rgb.data(), first, last);
+	};
+	forEachTile(src.height(), interleave);
 }
 
-float Warping::getYTransformInv(int u, int v) {
-	return ((c - u)*(v*m - d) - (f - v)*(u*m - a)) /
-		((u*l - b)*(v*m - d) - (v*l - e)*(u*m - a));
+/* Side in source pixels of the footprint of the destination pixel
+*  mapping to (X, Y, Z): the longer of the derivatives of the source
+*  point along u and along v (columns of the Jacobian) */
+float Warping::footprint(double X, double Y, double Z) {
+	double x = X / Z, y = Y / Z;
+	double xu = (inv[0] - x * inv[6]) / Z, yu = (inv[3] - y * inv[6]) / Z;
+	double xv = (inv[1] - x * inv[7]) / Z, yv = (inv[4] - y * inv[7]) / Z;
+	return sqrt(std::max(xu * xu + yu * yu, xv * xv + yv * yv));
 }
 
-float Warping::bilinearInterpolate(float x, float y, int c) {
-	int i = floorf(x), j = floorf(y);
-	float a = x - i, b = y - j;
-	return (1 - a)*(1 - b)*src(i, j, c) + a*(1 - b)*src(i + 1, j, c)
-		+ (1 - a)*b*src(i, j + 1, c) + a*b*src(i + 1, j + 1, c);
+/* Level k of the pyramid, level 0 is src_rgb */
+const float* Warping::level(int k) {
+	return k == 0 ? src_rgb.data() : mipmap.data() + level_offset[k];
 }
 
-void Warping::reverseMapping() {
-	cimg_forXYC(dest_A4, u, v, c) { // c indicates color channels
-		float x = getXTransformInv(u, v);
-		float y = getYTransformInv(u, v);
-		if(x >= 0 && y >= 0 && x + 1 < src.width() && y + 1 < src.height())
-		    dest_A4(u, v, c) = bilinearInterpolate(x, y, c);
+/* Pyramid of src_rgb for FILTER_MIPMAP. Only the levels down to the
+*  largest footprint of the crop are built: the footprint of a
+*  homography is largest at one of the corners of the crop. */
+void Warping::buildMipmap(Workspace* workspace) {
+	const int us[] = { 0, dest_img.width() - 1 }, vs[] = { 0, dest_img.height() - 1 };
+	float max_footprint = 1;
+	for (int i = 0; i < 4; ++i) {
+		int u = us[i % 2], v = vs[i / 2];
+		max_footprint = std::max(max_footprint, footprint(
+			inv[0] * u + inv[1] * v + inv[2],
+			inv[3] * u + inv[4] * v + inv[5],
+			inv[6] * u + inv[7] * v + inv[8]));
+	}
+	level_num = 1;
+	level_w[0] = src.width(), level_h[0] = src.height();
+	size_t size = 0;
+	while (level_num < MAX_LEVELS && (1 << (level_num - 1)) < max_footprint
+		&& level_w[level_num - 1] > 1 && level_h[level_num - 1] > 1) {
+		level_w[level_num] = level_w[level_num - 1] / 2;
+		level_h[level_num] = level_h[level_num - 1] / 2;
+		level_offset[level_num] = size;
+		size += 3 * (size_t)level_w[level_num] * level_h[level_num];
+		++level_num;
+	}
+	if (size == 0) return;
+	if (workspace) workspace->mipmap.bind(mipmap, (int)size, 1);
+	else mipmap.assign((int)size, 1);
+	for (int k = 1; k < level_num; ++k) {
+		// average of 2x2 pixels of the previous level
+		const float* prev = level(k - 1);
+		float* next = mipmap.data() + level_offset[k];
+		size_t prev_row = 3 * (size_t)level_w[k - 1];
+		auto halve = [&](int first, int last) {
+			for (int y = first; y < last; ++y) {
+				const float* p0 = prev + 2 * y * prev_row;
+				const float* p1 = p0 + prev_row;
+				float* q = next + 3 * (size_t)y * level_w[k];
+				for (int x = 0; x < level_w[k]; ++x, p0 += 6, p1 += 6)
+					for (int c = 0; c < 3; ++c)
+						*(q++) = 0.25f * (p0[c] + p0[3 + c] + p1[c] + p1[3 + c]);
+			}
+		};
+		forEachTile(level_h[k], halve);
+	}
+}
+
+/* Warp row v with FILTER_MIPMAP. The level of detail is log2 of the
+*  footprint: a footprint of 4 source pixels is one pixel of level 2.
+*  Pixels outside of the source are black as with the other kernels. */
+void Warping::warpRowMipmap(int v) {
+	const int src_w = src.width(), src_h = src.height();
+	float* dest_r = dest_img.data(0, v, 0, 0);
+	float* dest_g = dest_img.data(0, v, 0, 1);
+	float* dest_b = dest_img.data(0, v, 0, 2);
+	double X = inv[1] * v + inv[2], Y = inv[4] * v + inv[5],
+		Z = inv[7] * v + inv[8];
+	for (int u = 0; u < dest_img.width(); ++u) {
+		double r = 1 / Z;
+		float x = X * r, y = Y * r;
+		if (x >= 0 && y >= 0 && x + 1 < src_w && y + 1 < src_h) {
+			float lod = std::log2(std::max(1.0f, footprint(X, Y, Z)));
+			lod = std::min(lod, level_num - 1.0f);
+			int k = (int)lod;
+			float t = lod - k, pixel[3], coarse[3];
+			// pixel centers: (x + 0.5) / 2^k - 0.5 on level k
+			float scale = 1.0f / (1 << k);
+			if (k == 0) bilinearClamped(level(0), src_w, src_h, x, y, pixel);
+			else bilinearClamped(level(k), level_w[k], level_h[k],
+				(x + 0.5f) * scale - 0.5f, (y + 0.5f) * scale - 0.5f, pixel);
+			if (t > 0) {
+				scale *= 0.5f;
+				bilinearClamped(level(k + 1), level_w[k + 1], level_h[k + 1],
+					(x + 0.5f) * scale - 0.5f, (y + 0.5f) * scale - 0.5f, coarse);
+				for (int c = 0; c < 3; ++c)
+					pixel[c] = (1 - t) * pixel[c] + t * coarse[c];
+			}
+			dest_r[u] = pixel[0];
+			dest_g[u] = pixel[1];
+			dest_b[u] = pixel[2];
+		}
+		else {
+			dest_r[u] = dest_g[u] = dest_b[u] = 0;
+		}
+		X += inv[0], Y += inv[3], Z += inv[6];
 	}
 }
 
+/* Number of tasks for tile_num tiles, see forEachTile */
+int Warping::threadNum(int tile_num) {
+	int thread_num = options.threads;
+	if (thread_num <= 0) thread_num = std::thread::hardware_concurrency();
+	return std::max(1, std::min(thread_num, tile_num));
+}
+
+/* Source point (x, y) = (X / Z, Y / Z) of destination pixel (u, v)
+*  with (X, Y, Z) = inv * (u, v, 1). Along a row X, Y and Z only
+*  change by the first column of inv, so each pixel costs three adds
+*  and one division. Each pixel is sampled once for all channels.
+*  Rows are independent, tiles of TILE_ROWS rows are spread over the
+*  shared thread pool and every row is computed the same way whatever
+*  thread runs it, so the crop is the same with any number of threads. */
+void Warping::reverseMapping() {
+	const double step[] = { inv[0], inv[3], inv[6] };
+	auto warpRows = [&](int first, int last) {
+		for (int v = first; v < last; ++v) {
+			if (options.filter == FILTER_MIPMAP) {
+				warpRowMipmap(v);
+				continue;
+			}
+			row_kernel(src_rgb.data(), src.width(), src.height(),
+				inv[1] * v + inv[2], inv[4] * v + inv[5], inv[7] * v + inv[8],
+				step, dest_img.width(), dest_img.data(0, v, 0, 0),
+				dest_img.data(0, v, 0, 1), dest_img.data(0, v, 0, 2));
+		}
+	};
+	forEachTile(dest_img.height(), warpRows);
+}
@@ -10,30 +10,124 @@
 #ifndef _Warping_
 #define _Warping_
 #include "Hough.h"
+#include "RemapCache.h"
 #include<Eigen/Dense>
 
+/* Paper sizes the crop can have, see pageSize in Warping.cpp */
+enum PageFormat { PAGE_A4, PAGE_A5, PAGE_LETTER };
+/* Sampling of the source.
+*  FILTER_BILINEAR: the four nearest source pixels. Aliases when the
+*                   paper sheet is much larger in the source than the crop.
+*  FILTER_MIPMAP: bilinear on the two levels of a 2x2 box pyramid of the
+*                 source closest to the footprint of each crop pixel
+*                 (from the Jacobian of the homography), blended.
+*                 Same as bilinear where the crop is not smaller. */
+enum WarpFilter { FILTER_BILINEAR, FILTER_MIPMAP };
+struct WarpOptions {
+	// size of the crop in pixels, the original demo crop by default;
+	// use setPage for a paper size at a resolution
+	int width, height;
+	WarpFilter filter;
+	bool simd; // use the AVX2 bilinear kernel if the CPU supports it
+	int threads; // warping threads, 0 for all hardware threads
+	// remap tables of earlier crops to reuse, none by default; only
+	// used with FILTER_BILINEAR, see RemapCache.h
+	RemapCache* cache;
+	WarpOptions() : width(410), height(594), filter(FILTER_BILINEAR),
+		simd(true), threads(0), cache(NULL) {}
+	// crop size of page at dpi, e.g. A4 at 300 dpi is 2480*3508
+	void setPage(PageFormat page, float dpi);
+};
+
 class Warping {
 private:
-	CImg<float> dest_A4; // 210mm*297mm -> 410*594
-	CImg<float> src;
-	const float W = 410, H = 594;
-	// destination corners
-	const float u1 = 0, v1 = 0, // top-left
-		u2 = W - 1, v2 = 0, // top-right
-		u3 = 0, v3 = H - 1, // bottom-left
-		u4 = W - 1, v4 = H - 1; // bottom-right
+	CImg<float> dest_img; // options.width * options.height crop
+	CImg<float> src; // shared view of the source image, never copied
+	// red, green and blue of src next to each other, pixel (x, y) at
+	// src_rgb(3 * x, y), so a bilinear sample reads two short runs
+	CImg<float> src_rgb;
+	// levels 1, 2, ... of the FILTER_MIPMAP pyramid of src_rgb (level 0),
+	// each one half of the size of the previous one, see buildMipmap
+	CImg<float> mipmap;
+	// the same for the 8-bit path, see warp8; src_rgb8 is one row of
+	// all the pixels of src8
+	CImg<unsigned char> dest8_img, src8, src_rgb8;
+	static const int MAX_LEVELS = 16;
+	int level_num;
+	int level_w[MAX_LEVELS], level_h[MAX_LEVELS];
+	size_t level_offset[MAX_LEVELS]; // of the level in mipmap
+	const int TILE_ROWS = 16; // destination rows warped by a task at once
+	float W, H; // size of dest_img
+	// destination corners, see warp
+	float u1, v1, u2, v2, u3, v3, u4, v4;
 	float x1, y1, x2, y2, x3, y3, x4, y4; // source corners
 	float a, b, c, d, e, f, m, l; // parameters
+	// inverse homography, destination to source, row major 3x3
+	double inv[9];
+	WarpOptions options;
+	bool cropped; // false if there were not four corners, see ok()
+	// samples one destination row, see warpRowScalar in Warping.cpp
+	void (*row_kernel)(const float* rgb, int src_w, int src_h,
+		double X, double Y, double Z, const double* step, int n,
+		float* dest_r, float* dest_g, float* dest_b);
+	// row_kernel of the 8-bit path, see warpRow8Scalar
+	void (*row_kernel8)(const unsigned char* rgb, int src_w, int src_h,
+		double X, double Y, double Z, const double* step, int n,
+		unsigned char* dest_r, unsigned char* dest_g, unsigned char* dest_b);
+	// remap table of one destination row, see remapRowScalar
+	void (*remap_kernel)(int src_w, int src_h, double X, double Y, double Z,
+		const double* step, int n, int* index, unsigned short* fraction);
+	// samples one destination row from a remap table, see
+	// gatherRowScalar and gatherRow8Scalar
+	void (*gather_kernel)(const int* index, const unsigned short* fraction,
+		const float* src, int src_w, size_t plane, int n,
+		float* dest_r, float* dest_g, float* dest_b);
+	void (*gather_kernel8)(const int* index, const unsigned short* fraction,
+		const unsigned char* src, int src_w, size_t plane, int n,
+		unsigned char* dest_r, unsigned char* dest_g, unsigned char* dest_b);
 
+	void setCorners(const std::vector<Point>& corners);
+	RemapTable remapTable(const std::vector<Point>& corners,
+		int src_w, int src_h);
 	void perspectiveTransform();
-	float getXTransformInv(int u, int v);
-	float getYTransformInv(int u, int v);
+	template<typename Rows> void forEachTile(int height, Rows& rows);
+	void interleaveSource(Workspace* workspace);
+	float footprint(double X, double Y, double Z);
+	void buildMipmap(Workspace* workspace);
+	const float* level(int k);
+	int threadNum(int tile_num);
 	void reverseMapping();
-	float bilinearInterpolate(float x, float y, int z);
+	void warpRowMipmap(int v);
 	void mapping(float x, float y);
+	void warp(const CImg<float>& src_img, const std::vector<Point>& corners,
+		Workspace* workspace);
+	void warp8(const CImg<unsigned char>& src_img,
+		const std::vector<Point>& corners, Workspace* workspace);
+	friend class Benchmark;
 public:
-	Warping(Hough hough2);
-	CImg<float> getCroppedImg() { return dest_A4; }
+	// Crop the paper sheet with the four ordered corners (top-left,
+	// top-right, bottom-left, bottom-right) out of src_img. Only a view
+	// of src_img is kept, it must outlive the warping.
+	// dest_img is taken from workspace if any, it is then overwritten
+	// by the next warping with the same workspace. Without exactly four
+	// corners (e.g. after a failed detection) the crop is black and ok()
+	// is false.
+	Warping(const CImg<float>& src_img, const std::vector<Point>& corners,
+		WarpOptions _options = WarpOptions(), Workspace* workspace = NULL);
+	// same with the image and corners of a successful detection
+	Warping(const Hough& hough, WarpOptions _options = WarpOptions(),
+		Workspace* workspace = NULL);
+	// 8-bit path for images loaded as CImg<unsigned char>: fixed-point
+	// positions and integer bilinear weights, the crop is in
+	// getCroppedImg8(). It differs from the rounded float crop by at
+	// most two grey levels per channel: sub-pixel positions are
+	// truncated to 1/256 pixel (under one level at a black to white
+	// edge) and the result is rounded. options.filter is ignored.
+	Warping(const CImg<unsigned char>& src_img, const std::vector<Point>& corners,
+		WarpOptions _options = WarpOptions(), Workspace* workspace = NULL);
+	const CImg<float>& getCroppedImg() const { return dest_img; }
+	const CImg<unsigned char>& getCroppedImg8() const { return dest8_img; }
+	bool ok() const { return cropped; }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+/*
+#  File        : Workspace.h
+#  Description : Reusable buffers of the detection and warping stages
+#  Copyright   : HYPJUDY 2017/4/6
+#  Details     : https://hypjudy.github.io/2017/03/28/cvpr-A4-paper-sheet-detection-and-cropping/
+#  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
+*/
+
+#pragma once
+#ifndef _Workspace_
+#define _Workspace_
+#include "CImg.h"
+#include<vector>
+#include<stdint.h>
+using namespace cimg_library;
+
+/* Memory that only grows. Images are bound to it as shared CImg
+*  views, so an image of the same or a smaller size than any image
+*  before does not allocate anything. */
+template<typename T>
+class Buffer {
+private:
+	std::vector<T> storage;
+public:
+	/* At least n elements, growing only if there are fewer */
+	T* reserve(size_t n) {
+		if (storage.size() < n) storage.resize(n);
+		return storage.data();
+	}
+	/* Make img a shared view of the given size on the buffer.
+	*  The content is undefined, previous views become invalid
+	*  if the buffer has to grow. */
+	CImg<T>& bind(CImg<T>& img, int width, int height,
+		int depth = 1, int spectrum = 1) {
+		size_t n = (size_t)width * height * depth * spectrum;
+		return img.assign(reserve(n), width, height, depth, spectrum, true);
+	}
+	size_t capacity() const { return storage.size(); }
+	/* Exchange the memory of two buffers, views stay on their memory */
+	void swap(Buffer& other) { storage.swap(other.storage); }
+};
+
+/* Buffers of every per-image stage. Hough and Warping take their
+*  images from a workspace instead of allocating new ones, so a
+*  stream of images of the same size runs without heap allocations
+*  once the buffers have grown to that size. A workspace must not be
+*  used by two detections at the same time, give each thread its own. */
+struct Workspace {
+	Buffer<float> rgb; // copy of the input image
+	Buffer<float> proxy; // downscaled input, see Hough::initSource
+	Buffer<float> gray;
+	Buffer<float> gradients;
+	Buffer<float> marked;
+	Buffer<float> blur_line; // one row or column, see Hough::blur
+	Buffer<float> blurred; // output of the separable blur, see Hough::blur
+	Buffer<float> stream_rows; // rolling rows of Hough::streamEdges
+	Buffer<float> pyramid; // coarser levels of Hough::getPyramidHoughEdges
+	Buffer<int> refine_votes; // see Hough::refineHoughEdges
+	// hough accumulators and the per thread partial accumulators
+	Buffer<uint16_t> hough16, partial16;
+	Buffer<uint32_t> hough32, partial32;
+	Buffer<float> interleaved; // source of Warping, see Warping::src_rgb
+	Buffer<float> mipmap; // see Warping::mipmap
+	Buffer<float> warped; // cropped image of Warping
+	Buffer<unsigned char> interleaved8, warped8; // same for 8-bit images
+
+	Buffer<uint16_t>& hough(uint16_t) { return hough16; }
+	Buffer<uint32_t>& hough(uint32_t) { return hough32; }
+	Buffer<uint16_t>& partial(uint16_t) { return partial16; }
+	Buffer<uint32_t>& partial(uint32_t) { return partial32; }
+};
+
+#endif
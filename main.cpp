@@ -7,9 +7,11 @@
 #  Code        : https://github.com/HYPJUDY/A4-paper-sheet-detection-and-cropping
 */
 
+#include "Benchmark.h"
 #include "Warping.h"
 int main() {
 	int CASE = 1; // 1 for dataset1; otherwise for dataset2
+	bool BENCHMARK = false; // true to run benchmarks instead of cropping
 
 	/* Parameters for dataset */
 	int image_num = 16;
@@ -22,7 +24,28 @@ int main() {
 		image_num = 5;
 		data_folder = "dataset2/";
 	}
+
+	if (BENCHMARK) {
+		bool passed = true; // exit with 1 if any check failed
+		Benchmark::houghVoting(data_folder, image_num);
+		Benchmark::houghThreads(data_folder, image_num);
+		Benchmark::houghLayout(data_folder, image_num);
+		passed &= Benchmark::houghSimd(data_folder, image_num);
+		passed &= Benchmark::allocations(data_folder, image_num);
+		passed &= Benchmark::warpSimd(data_folder, image_num);
+		passed &= Benchmark::warpThreads(data_folder, image_num);
+		Benchmark::warpSizes(data_folder, image_num);
+		Benchmark::warpDownsampling(data_folder, image_num);
+		passed &= Benchmark::warp8Bit(data_folder, image_num);
+		passed &= Benchmark::warpCache(data_folder, image_num);
+		passed &= Benchmark::gray8Bit(data_folder, image_num);
+		passed &= Benchmark::blurModes(data_folder, image_num);
+		passed &= Benchmark::edgeStreaming(data_folder, image_num);
+		Benchmark::pyramidLevels(data_folder, image_num);
+		return passed ? 0 : 1;
+	}
 	
+	int exit_code = 0; // status of the last failed image, see below
 	// adjust the num array below to process different image
 	std::vector<const char*> num = { "0", "1", "2", "3", "4", "5",
 		"6", "7", "8", "9", "10", "11", "12", "13", "14", "15", "16" };
@@ -34,6 +57,10 @@ int main() {
 		strcat(inPath, ".bmp");
 		
 		Hough hough(inPath);
+		if (hough.getStatus() != DETECTION_OK) { // skip this image
+			exit_code = hough.getStatus();
+			continue;
+		}
 		Warping Warping(hough);
 		
 		char outPath[80];
@@ -48,14 +75,19 @@ int main() {
 		strcat(outPath2, "_A4.bmp");
 		Warping.getCroppedImg().display().save(outPath2);
 	}
-	return 0;
+	return exit_code;
 }
 
-/* Error cases guide:
-* exit(-1): ERROR: Please set parameter Q larger in file \
-*			'hough_transform.h' to filter out four edges!
-* exit(-2): ERROR: Bug in function void Hough::getHoughEdges()!\
+/* Error cases guide (DetectionStatus in Hough.h). A failed image
+* is skipped, the program goes on and exits with the last error.
+* -1 TOO_FEW_EDGES: ERROR: Please set parameter Q larger in file \
+*			'Hough.h' to filter out four edges!
+* -2 EDGE_FILTER_FAILED: ERROR: Bug in function void Hough::filterHoughEdges()!\
 *           Please check the ifelse statement to filter out four hough_edges.
-* exit(-3): ERROR: Can not detect four ordered_corners in function \
+* -3 TOO_FEW_CORNERS: ERROR: Can not detect four ordered_corners in function \
             void Hough::orderCorners(). Please try to adjust parameters.
+* -4 DEGENERATE_CORNERS: ERROR: The four edges found in function void \
+*           Hough::getCorners() do not form a quadrilateral. Please try \
+*           a larger detection_scale.
+* With BENCHMARK set, the program exits with 1 if a benchmark check failed.
 */
\ No newline at end of file